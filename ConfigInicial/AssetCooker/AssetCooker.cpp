@@ -0,0 +1,249 @@
+﻿#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iostream>
+#include "Model.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "MappedFile.h"
+#include "AssetPack.h"
+#include "SOIL2/SOIL2.h"
+
+// Cocina offline de los assets de Models/Proyecto: deja junto a cada .obj su .meshcache y junto a cada
+// textura su .dds (comprimido en DXT1 con todos sus mips), que el ejecutable principal usa en lugar de importar
+// y decodificar al arrancar.
+// Solo se procesan las fuentes que cambiaron desde la última cocina, y cada asset es una tarea del pool.
+//
+// Uso: AssetCooker [--uncompressed-textures] [--assimp-obj] [--pack] [--bench-obj] [carpeta]
+//   carpeta: por defecto Models/Proyecto, relativa a la carpeta del proyecto ConfigInicial
+//   --uncompressed-textures: texturas RGB sin comprimir, para el ejecutable lanzado con la misma opción
+//   --assimp-obj: importa los .obj con ASSIMP en lugar de ObjParser, para el ejecutable lanzado con la misma opción
+//   --pack: al terminar empaqueta toda la carpeta, fuentes y cocinados, en <carpeta>.pak (ver AssetPack.h)
+//   --bench-obj: en lugar de cocinar, compara ASSIMP con ObjParser leyendo los .obj más grandes
+
+struct CookTotals {
+    std::atomic<int> cooked;
+    std::atomic<int> upToDate;
+    std::atomic<int> failed;
+};
+
+float ElapsedMs(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool EndsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Agrega a files las rutas, relativas a root, de todos los archivos bajo root/relative salvo los temporales
+void CollectFiles(const std::string& root, const std::string& relative, std::vector<std::string>& files) {
+    std::vector<std::string> names, folders;
+    ListDirectory(relative.empty() ? root : root + "/" + relative, names, folders);
+    std::string prefix = relative.empty() ? "" : relative + "/";
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!EndsWith(names[i], ".tmp")) {
+            files.push_back(prefix + names[i]);
+        }
+    }
+    for (size_t i = 0; i < folders.size(); ++i) {
+        CollectFiles(root, prefix + folders[i], files);
+    }
+}
+
+// Decodifica una imagen y la guarda en el formato de TextureCache::DefaultFormat() si su .dds no existe o es más viejo
+void CookTexture(const std::string& path, CookTotals& totals) {
+    TextureCache cache;
+    if (cache.Open(path, TextureCache::DefaultFormat())) {
+        totals.upToDate++;
+        std::cout << "COOKER::UP_TO_DATE " + path + "\n";
+        return;
+    }
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    int width = 0, height = 0;
+    unsigned char* pixels = SOIL_load_image(path.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+    if (!pixels) {
+        totals.failed++;
+        std::cout << "ERROR::COOKER::DECODE_FAILED " + path + "\n";
+        return;
+    }
+    bool written = TextureCache::Write(path, width, height, pixels, TextureCache::DefaultFormat());
+    SOIL_free_image_data(pixels);
+    if (!written) {
+        totals.failed++;
+        return;
+    }
+
+    totals.cooked++;
+    std::ostringstream log;
+    log << "COOKER::COOKED " << path << " " << ElapsedMs(start) << " ms" << std::endl;
+    std::cout << log.str();
+}
+
+// Importa un modelo con el pipeline de Model (triangulación, soldado, LODs, optimización, meshlets), que escribe
+// su .meshcache, y encola sus texturas. Cada textura se cocina una sola vez aunque la usen varios modelos.
+void CookModel(const std::string& path, ThreadPool& pool, std::set<std::string>& claimed, std::mutex& claimedMutex, CookTotals& totals) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    MeshCache cache;
+    bool upToDate = cache.Open(path, MODEL_IMPORT_FLAGS, Model::ImportSettingsHash());
+    cache.Close();
+
+    Model model;
+    model.Import(path);
+    if (upToDate) {
+        totals.upToDate++;
+        std::cout << "COOKER::UP_TO_DATE " + path + "\n";
+    }
+    else if (cache.Open(path, MODEL_IMPORT_FLAGS, Model::ImportSettingsHash())) {
+        totals.cooked++;
+        std::ostringstream log;
+        log << "COOKER::COOKED " << path << " " << ElapsedMs(start) << " ms" << std::endl;
+        std::cout << log.str();
+    }
+    else {
+        totals.failed++;
+        std::cout << "ERROR::COOKER::IMPORT_FAILED " + path + "\n";
+    }
+
+    std::vector<std::string> textures = model.TextureFiles();
+    for (size_t i = 0; i < textures.size(); ++i) {
+        std::lock_guard<std::mutex> lock(claimedMutex);
+        if (claimed.insert(NormalizePath(textures[i])).second) {
+            std::string texture = textures[i];
+            pool.Submit([texture, &totals] { CookTexture(texture, totals); });
+        }
+    }
+}
+
+// Mejor de BENCH_RUNS lecturas de un .obj, sin soldar ni optimizar; cuenta sus mallas y vértices
+const int BENCH_RUNS = 3;
+float BenchReadMeshes(const std::string& path, bool objParser, size_t& meshes, size_t& vertices) {
+    float best = 0.0f;
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        std::vector<MeshData> data;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        Model::ReadMeshes(path, objParser, data);
+        float ms = ElapsedMs(start);
+        best = run == 0 ? ms : std::min(best, ms);
+
+        meshes = data.size();
+        vertices = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            vertices += data[i].vertices.size();
+        }
+    }
+    return best;
+}
+
+// Compara los dos lectores de .obj en los BENCH_MODELS archivos más grandes
+const size_t BENCH_MODELS = 5;
+void BenchObj(const std::vector<std::string>& models) {
+    std::vector<std::pair<size_t, std::string> > bySize;
+    for (size_t i = 0; i < models.size(); ++i) {
+        FileStamp stamp;
+        if (GetFileStamp(models[i], stamp)) {
+            bySize.push_back(std::make_pair(size_t(stamp.size), models[i]));
+        }
+    }
+    std::sort(bySize.rbegin(), bySize.rend());
+
+    for (size_t i = 0; i < bySize.size() && i < BENCH_MODELS; ++i) {
+        size_t assimpMeshes, assimpVertices, objMeshes, objVertices;
+        float assimpMs = BenchReadMeshes(bySize[i].second, false, assimpMeshes, assimpVertices);
+        float objMs = BenchReadMeshes(bySize[i].second, true, objMeshes, objVertices);
+
+        std::ostringstream log;
+        log << "COOKER::BENCH_OBJ " << bySize[i].second << " " << bySize[i].first / 1024 << " KB: ASSIMP " << assimpMs << " ms, ObjParser "
+            << objMs << " ms (" << (objMs > 0.0f ? assimpMs / objMs : 0.0f) << "x); " << assimpMeshes << " / " << objMeshes << " meshes, "
+            << assimpVertices << " / " << objVertices << " vertices" << std::endl;
+        std::cout << log.str();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string root = "Models/Proyecto";
+    bool pack = false;
+    bool benchObj = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--uncompressed-textures") {
+            TextureCache::DefaultFormat() = TEXTURE_FORMAT_RGB;
+        }
+        else if (std::string(argv[i]) == "--assimp-obj") {
+            Model::ObjParserEnabled() = false;
+        }
+        else if (std::string(argv[i]) == "--pack") {
+            pack = true;
+        }
+        else if (std::string(argv[i]) == "--bench-obj") {
+            benchObj = true;
+        }
+        else {
+            root = argv[i];
+        }
+    }
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    // Cada subcarpeta de la raíz trae sus .obj con sus .mtl y texturas
+    std::vector<std::string> models, files, folders, folderFiles, subfolders;
+    if (!ListDirectory(root, files, folders)) {
+        std::cout << "ERROR::COOKER::NO_DIRECTORY " << root << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < folders.size(); ++i) {
+        std::string folder = root + "/" + folders[i];
+        ListDirectory(folder, folderFiles, subfolders);
+        for (size_t j = 0; j < folderFiles.size(); ++j) {
+            if (EndsWith(folderFiles[j], ".obj")) {
+                models.push_back(folder + "/" + folderFiles[j]);
+            }
+        }
+    }
+
+    if (benchObj) {
+        BenchObj(models);
+        return EXIT_SUCCESS;
+    }
+
+    ThreadPool& pool = ThreadPool::Shared();
+    CookTotals totals;
+    totals.cooked = 0;
+    totals.upToDate = 0;
+    totals.failed = 0;
+    std::set<std::string> claimed;
+    std::mutex claimedMutex;
+    for (size_t i = 0; i < models.size(); ++i) {
+        std::string path = models[i];
+        pool.Submit([path, &pool, &claimed, &claimedMutex, &totals] { CookModel(path, pool, claimed, claimedMutex, totals); });
+    }
+    // Espera también a las texturas que encolaron los modelos
+    pool.Wait();
+
+    std::ostringstream log;
+    log << "COOKER:: " << models.size() << " models, " << (totals.cooked + totals.upToDate + totals.failed) << " assets ("
+        << totals.cooked << " cooked, " << totals.upToDate << " up to date, " << totals.failed << " failed) on "
+        << pool.Size() << " threads in " << ElapsedMs(start) << " ms" << std::endl;
+    std::cout << log.str();
+
+    // El paquete se rehace entero: las entradas están ordenadas y alineadas, y escribirlo cuesta poco frente a cocinar
+    if (pack) {
+        std::chrono::high_resolution_clock::time_point packStart = std::chrono::high_resolution_clock::now();
+        std::vector<std::string> packed;
+        CollectFiles(root, "", packed);
+        if (!AssetPack::Write(root, packed)) {
+            return EXIT_FAILURE;
+        }
+        FileStamp stamp;
+        GetFileStamp(AssetPack::PackPath(root), stamp);
+        std::ostringstream packLog;
+        packLog << "COOKER::PACKED " << AssetPack::PackPath(root) << " " << packed.size() << " files, " << stamp.size / (1024 * 1024)
+            << " MB in " << ElapsedMs(packStart) << " ms" << std::endl;
+        std::cout << packLog.str();
+    }
+
+    return totals.failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
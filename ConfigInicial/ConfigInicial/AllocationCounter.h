@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Counts the heap allocations made while it is alive: on the thread that created it, and on the workers a
+// ThreadPool::ParallelFor started from that thread lends to it. Scopes nest, an allocation counts in every
+// enclosing one. Only bytes freed while the scope is current are subtracted, so PeakBytes() is the peak of
+// what the scope itself held.
+//
+// The counting replaces the global operator new and delete, in the single translation unit that defines
+// ALLOCATION_COUNTER_IMPLEMENTATION before including this header; Proyecto.cpp only does so in Debug builds.
+// Without it the scopes count nothing.
+class AllocationScope
+{
+public:
+	AllocationScope() : parent(Current()), allocations(0), liveBytes(0), peakBytes(0)
+	{
+		Current() = this;
+	}
+
+	~AllocationScope()
+	{
+		Current() = this->parent;
+	}
+
+	size_t Allocations() const
+	{
+		return this->allocations;
+	}
+
+	size_t PeakBytes() const
+	{
+		return static_cast<size_t>(this->peakBytes.load());
+	}
+
+	// Whether operator new is counted at all
+	static bool &Enabled()
+	{
+		static bool enabled = false;
+		return enabled;
+	}
+
+	// Innermost scope of the calling thread, nullptr if none
+	static AllocationScope *&Current()
+	{
+		static thread_local AllocationScope *current = nullptr;
+		return current;
+	}
+
+	// Makes another thread's scope the current one of this thread while alive, for work done on its behalf
+	class Lend
+	{
+	public:
+		explicit Lend(AllocationScope *scope) : previous(Current())
+		{
+			Current() = scope;
+		}
+
+		~Lend()
+		{
+			Current() = this->previous;
+		}
+
+	private:
+		AllocationScope *previous;
+	};
+
+	// Called by the replaced operator new and delete
+	void Allocated(size_t bytes)
+	{
+		for (AllocationScope *scope = this; scope; scope = scope->parent)
+		{
+			scope->allocations++;
+			ptrdiff_t live = scope->liveBytes += static_cast<ptrdiff_t>(bytes);
+			ptrdiff_t peak = scope->peakBytes;
+			while (live > peak && !scope->peakBytes.compare_exchange_weak(peak, live))
+			{
+			}
+		}
+	}
+
+	void Freed(size_t bytes)
+	{
+		for (AllocationScope *scope = this; scope; scope = scope->parent)
+		{
+			scope->liveBytes -= static_cast<ptrdiff_t>(bytes);
+		}
+	}
+
+private:
+	AllocationScope(const AllocationScope &);
+	AllocationScope &operator=(const AllocationScope &);
+
+	AllocationScope *parent;
+	atomic<size_t> allocations;
+	atomic<ptrdiff_t> liveBytes;
+	atomic<ptrdiff_t> peakBytes;
+};
+
+#ifdef ALLOCATION_COUNTER_IMPLEMENTATION
+
+// Every block carries its size in front, so frees can be counted too. 16 bytes keep the alignment malloc gives.
+const size_t ALLOCATION_HEADER_SIZE = 16;
+
+static const bool allocationCounterEnabled = (AllocationScope::Enabled() = true);
+
+static void *countedAllocate(size_t size)
+{
+	char *block = static_cast<char *>(malloc(size + ALLOCATION_HEADER_SIZE));
+	if (!block)
+	{
+		return nullptr;
+	}
+	*reinterpret_cast<size_t *>(block) = size;
+	if (AllocationScope *scope = AllocationScope::Current())
+	{
+		scope->Allocated(size);
+	}
+	return block + ALLOCATION_HEADER_SIZE;
+}
+
+static void countedFree(void *pointer)
+{
+	if (!pointer)
+	{
+		return;
+	}
+	char *block = static_cast<char *>(pointer) - ALLOCATION_HEADER_SIZE;
+	if (AllocationScope *scope = AllocationScope::Current())
+	{
+		scope->Freed(*reinterpret_cast<size_t *>(block));
+	}
+	free(block);
+}
+
+void *operator new(size_t size)
+{
+	void *pointer = countedAllocate(size);
+	if (!pointer)
+	{
+		throw bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+	return countedAllocate(size);
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+	return countedAllocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+	countedFree(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+	countedFree(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	countedFree(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+	countedFree(pointer);
+}
+
+void operator delete(void *pointer, const nothrow_t &) noexcept
+{
+	countedFree(pointer);
+}
+
+void operator delete[](void *pointer, const nothrow_t &) noexcept
+{
+	countedFree(pointer);
+}
+
+#endif
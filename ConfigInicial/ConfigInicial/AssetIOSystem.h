@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "AssetPack.h"
+
+using namespace std;
+
+// ASSIMP file over an AssetFile: the importer reads the OBJ and its MTL from the mapped pack (or loose file)
+// instead of through its own std streams
+class AssetIOStream : public Assimp::IOStream
+{
+public:
+	AssetIOStream() : position(0)
+	{
+	}
+
+	bool Open(const string &path)
+	{
+		return this->file.Open(path);
+	}
+
+	size_t Read(void *buffer, size_t size, size_t count) override
+	{
+		if (size == 0)
+		{
+			return 0;
+		}
+
+		size_t available = (this->file.Size() - this->position) / size;
+		count = count < available ? count : available;
+		memcpy(buffer, this->file.Data() + this->position, size * count);
+		this->position += size * count;
+		return count;
+	}
+
+	size_t Write(const void * /*buffer*/, size_t /*size*/, size_t /*count*/) override
+	{
+		return 0;
+	}
+
+	aiReturn Seek(size_t offset, aiOrigin origin) override
+	{
+		size_t base = origin == aiOrigin_CUR ? this->position : origin == aiOrigin_END ? this->file.Size() : 0;
+		// aiOrigin_END offsets come as a negative number wrapped around, as in ASSIMP's own DefaultIOStream
+		size_t target = base + offset;
+		if (target > this->file.Size())
+		{
+			return aiReturn_FAILURE;
+		}
+		this->position = target;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const override
+	{
+		return this->position;
+	}
+
+	size_t FileSize() const override
+	{
+		return this->file.Size();
+	}
+
+	void Flush() override
+	{
+	}
+
+private:
+	AssetFile file;
+	size_t position;
+};
+
+// Read-only file system handed to the importer, see AssetPack. Remembers the files it was asked to open,
+// so the mesh cache can be keyed on the MTL libraries too.
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+	// Every path passed to Open(), whether it existed or not
+	const vector<string> &Opened() const
+	{
+		return this->opened;
+	}
+
+	bool Exists(const char *path) const override
+	{
+		FileStamp stamp;
+		return GetAssetStamp(path, stamp);
+	}
+
+	char getOsSeparator() const override
+	{
+		return '/';
+	}
+
+	Assimp::IOStream *Open(const char *path, const char *mode) override
+	{
+		if (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+'))
+		{
+			return nullptr;
+		}
+
+		this->opened.push_back(path);
+		AssetIOStream *stream = new AssetIOStream();
+		if (!stream->Open(path))
+		{
+			delete stream;
+			return nullptr;
+		}
+		return stream;
+	}
+
+	void Close(Assimp::IOStream *stream) override
+	{
+		delete stream;
+	}
+
+private:
+	vector<string> opened;
+};
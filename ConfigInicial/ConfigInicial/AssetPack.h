@@ -0,0 +1,363 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include "MappedFile.h"
+#include "LZ4.h"
+
+using namespace std;
+
+// Bump whenever the layout of the pack file changes
+const uint32_t ASSET_PACK_VERSION = 1;
+// Offset alignment of every entry, so the caches inside can be read in place as when mapped on their own
+const size_t ASSET_PACK_ALIGNMENT = 16;
+// An entry is stored compressed only if LZ4 brings it below this fraction of its size. JPG and PNG never get there
+// and are left as they are, so they keep being read straight from the mapping.
+const float ASSET_PACK_MIN_SAVING = 0.9f;
+
+// Every file of an asset folder in one memory-mapped archive, <folder>.pak next to the folder, written by the asset
+// cooker. Opening one file costs a binary search in the sorted index instead of an open, a stat and reads on the
+// disk (plus the stat while the loose folder is still around, see FindCurrent); stored entries are used in place
+// and LZ4 ones are decompressed once by whoever opens them.
+// Layout: Header, entry data, then the index (Entry array sorted by path and the path characters) at indexOffset.
+class AssetPack
+{
+public:
+	struct Header
+	{
+		char magic[4];				// "APAK"
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t pathBytes;
+		uint64_t indexOffset;
+	};
+
+	struct Entry
+	{
+		uint64_t offset;
+		uint64_t storedSize;		// Bytes in the pack
+		uint64_t size;				// Bytes of the file, same as storedSize unless compressed
+		int64_t sourceSize;			// Stamp of the file when packed, what GetAssetStamp() answers
+		int64_t sourceMTime;
+		uint32_t pathOffset;		// Path relative to the packed folder, normalized
+		uint32_t pathLength;
+		uint32_t compressed;
+		uint32_t reserved;
+	};
+
+	// The pack every AssetFile looks into first, mounted once at startup before any loading
+	static AssetPack &Instance()
+	{
+		static AssetPack pack;
+		return pack;
+	}
+
+	// Returns the path of the pack of a folder
+	static string PackPath(const string &folder)
+	{
+		return folder + ".pak";
+	}
+
+	// Maps the pack of the given folder. Returns false if there is none or it is not valid, loose files are read then.
+	bool Mount(const string &folder)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		this->Unmount();
+		if (!this->file.Open(PackPath(folder)))
+		{
+			return false;
+		}
+
+		const unsigned char *data = this->file.Data();
+		size_t size = this->file.Size();
+		const Header *h = reinterpret_cast<const Header *>(data);
+		if (size < sizeof(Header) || memcmp(h->magic, "APAK", 4) != 0 || h->version != ASSET_PACK_VERSION ||
+			h->indexOffset > size || (size - h->indexOffset) / sizeof(Entry) < h->entryCount ||
+			size - h->indexOffset - h->entryCount * sizeof(Entry) < h->pathBytes)
+		{
+			cout << "ERROR::ASSET_PACK::INVALID " << PackPath(folder) << endl;
+			this->file.Close();
+			return false;
+		}
+
+		const Entry *entries = reinterpret_cast<const Entry *>(data + h->indexOffset);
+		for (uint32_t i = 0; i < h->entryCount; i++)
+		{
+			if (entries[i].offset > size || entries[i].storedSize > size - entries[i].offset ||
+				uint64_t(entries[i].pathOffset) + entries[i].pathLength > h->pathBytes ||
+				(!entries[i].compressed && entries[i].storedSize != entries[i].size))
+			{
+				cout << "ERROR::ASSET_PACK::INVALID " << PackPath(folder) << endl;
+				this->file.Close();
+				return false;
+			}
+		}
+
+		this->entries = entries;
+		this->entryCount = h->entryCount;
+		this->paths = reinterpret_cast<const char *>(entries + h->entryCount);
+		this->prefix = NormalizePath(folder) + "/";
+
+		ostringstream log;
+		log << "ASSET_PACK::MOUNTED " << PackPath(folder) << " " << this->entryCount << " files, " << size / (1024 * 1024) << " MB in "
+			<< chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count() << " ms" << endl;
+		cout << log.str();
+		return true;
+	}
+
+	void Unmount()
+	{
+		this->file.Close();
+		this->entries = nullptr;
+		this->entryCount = 0;
+		this->paths = nullptr;
+		this->prefix.clear();
+	}
+
+	// Returns the entry of a file inside the mounted folder, nullptr if it is not in the pack
+	const Entry *Find(const string &path) const
+	{
+		if (!this->entries)
+		{
+			return nullptr;
+		}
+
+		string key = NormalizePath(path);
+		if (key.compare(0, this->prefix.size(), this->prefix) != 0)
+		{
+			return nullptr;
+		}
+		key.erase(0, this->prefix.size());
+
+		const Entry *end = this->entries + this->entryCount;
+		const Entry *entry = lower_bound(this->entries, end, key, [this](const Entry &e, const string &k)
+		{
+			return k.compare(0, string::npos, this->paths + e.pathOffset, e.pathLength) > 0;
+		});
+		return entry != end && key.compare(0, string::npos, this->paths + entry->pathOffset, entry->pathLength) == 0 ? entry : nullptr;
+	}
+
+	// Same as Find(), unless a loose copy of the file next to the pack has another stamp than the entry: a source
+	// edited after packing, or a cache rewritten because the packed one did not match the settings. The loose file
+	// wins then, so those are not shadowed by the pack forever. Costs a stat when the loose tree is there.
+	const Entry *FindCurrent(const string &path) const
+	{
+		const Entry *entry = this->Find(path);
+		FileStamp stamp;
+		if (entry && GetFileStamp(path, stamp) && (stamp.size != entry->sourceSize || stamp.mtime != entry->sourceMTime))
+		{
+			return nullptr;
+		}
+		return entry;
+	}
+
+	// Bytes of an entry as stored in the pack. Valid while the pack is mounted.
+	const unsigned char *StoredData(const Entry &entry) const
+	{
+		return this->file.Data() + entry.offset;
+	}
+
+	// Packs the given files of a folder (paths relative to it) into PackPath(folder), replacing it whole
+	static bool Write(const string &folder, vector<string> files)
+	{
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			files[i] = NormalizePath(files[i]);
+		}
+		sort(files.begin(), files.end());
+		files.erase(unique(files.begin(), files.end()), files.end());
+
+		string packPath = PackPath(folder);
+		string tempPath = packPath + ".tmp";
+		ofstream out(tempPath.c_str(), ios::binary | ios::trunc);
+
+		Header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, "APAK", 4);
+		h.version = ASSET_PACK_VERSION;
+		out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+		// Entries are streamed in one by one, only the index is kept
+		static const char padding[ASSET_PACK_ALIGNMENT] = {};
+		vector<Entry> entries;
+		string paths;
+		vector<unsigned char> compressed;
+		uint64_t offset = sizeof(h);
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			string path = folder + "/" + files[i];
+			MappedFile source;
+			FileStamp stamp;
+			if (!GetFileStamp(path, stamp) || (stamp.size > 0 && !source.Open(path)))
+			{
+				cout << "ERROR::ASSET_PACK::READ_FAILED " << path << endl;
+				out.close();
+				remove(tempPath.c_str());
+				return false;
+			}
+
+			Entry entry;
+			memset(&entry, 0, sizeof(entry));
+			entry.offset = (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+			entry.size = source.Size();
+			entry.sourceSize = stamp.size;
+			entry.sourceMTime = stamp.mtime;
+			entry.pathOffset = static_cast<uint32_t>(paths.size());
+			entry.pathLength = static_cast<uint32_t>(files[i].size());
+			paths += files[i];
+
+			LZ4Compress(source.Data(), source.Size(), compressed);
+			entry.compressed = compressed.size() < ASSET_PACK_MIN_SAVING * source.Size() ? 1 : 0;
+			const unsigned char *stored = entry.compressed ? compressed.data() : source.Data();
+			entry.storedSize = entry.compressed ? compressed.size() : source.Size();
+
+			out.write(padding, static_cast<streamsize>(entry.offset - offset));
+			out.write(reinterpret_cast<const char *>(stored), static_cast<streamsize>(entry.storedSize));
+			offset = entry.offset + entry.storedSize;
+			entries.push_back(entry);
+		}
+
+		h.entryCount = static_cast<uint32_t>(entries.size());
+		h.pathBytes = static_cast<uint32_t>(paths.size());
+		h.indexOffset = (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+		out.write(padding, static_cast<streamsize>(h.indexOffset - offset));
+		out.write(reinterpret_cast<const char *>(entries.data()), static_cast<streamsize>(entries.size() * sizeof(Entry)));
+		out.write(paths.data(), static_cast<streamsize>(paths.size()));
+		out.seekp(0);
+		out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+		out.close();
+		if (!out)
+		{
+			cout << "ERROR::ASSET_PACK::WRITE_FAILED " << packPath << endl;
+			remove(tempPath.c_str());
+			return false;
+		}
+
+		remove(packPath.c_str());
+		if (rename(tempPath.c_str(), packPath.c_str()) != 0)
+		{
+			cout << "ERROR::ASSET_PACK::WRITE_FAILED " << packPath << endl;
+			remove(tempPath.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	MappedFile file;
+	const Entry *entries;
+	uint32_t entryCount;
+	const char *paths;
+	string prefix;					// Normalized folder of the pack, with a trailing slash
+
+	AssetPack() : entries(nullptr), entryCount(0), paths(nullptr)
+	{
+	}
+};
+
+// Stamp of a file as the caches see it: the one recorded in the pack, or the file on disk when that one is newer
+bool GetAssetStamp(const string &path, FileStamp &stamp)
+{
+	const AssetPack::Entry *entry = AssetPack::Instance().FindCurrent(path);
+	if (entry)
+	{
+		stamp.size = entry->sourceSize;
+		stamp.mtime = entry->sourceMTime;
+		return true;
+	}
+	return GetFileStamp(path, stamp);
+}
+
+// Read-only view of a whole asset, from the mounted pack or else the file on disk (see AssetPack::FindCurrent), with
+// the same interface as MappedFile. Stored pack entries and loose files are mapped, compressed entries are
+// decompressed into the view.
+class AssetFile
+{
+public:
+	AssetFile() : data(nullptr), size(0)
+	{
+	}
+
+	// Opens the asset at the given path. Returns false if it cannot be found or read, or is empty.
+	bool Open(const string &path)
+	{
+		this->Close();
+
+		const AssetPack::Entry *entry = AssetPack::Instance().FindCurrent(path);
+		if (!entry)
+		{
+			if (!this->file.Open(path))
+			{
+				return false;
+			}
+			this->data = this->file.Data();
+			this->size = this->file.Size();
+			return true;
+		}
+
+		if (entry->size == 0)
+		{
+			return false;
+		}
+
+		const unsigned char *stored = AssetPack::Instance().StoredData(*entry);
+		if (entry->compressed)
+		{
+			this->buffer.resize(static_cast<size_t>(entry->size));
+			if (!LZ4Decompress(stored, static_cast<size_t>(entry->storedSize), this->buffer.data(), this->buffer.size()))
+			{
+				cout << "ERROR::ASSET_PACK::CORRUPT " << path << endl;
+				this->Close();
+				return false;
+			}
+			stored = this->buffer.data();
+		}
+
+		this->data = stored;
+		this->size = static_cast<size_t>(entry->size);
+		return true;
+	}
+
+	void Close()
+	{
+		this->file.Close();
+		// Swapped out rather than cleared, a closed view keeps no memory
+		vector<unsigned char>().swap(this->buffer);
+		this->data = nullptr;
+		this->size = 0;
+	}
+
+	bool IsOpen() const
+	{
+		return this->data != nullptr;
+	}
+
+	const unsigned char *Data() const
+	{
+		return this->data;
+	}
+
+	size_t Size() const
+	{
+		return this->size;
+	}
+
+private:
+	AssetFile(const AssetFile &);
+	AssetFile &operator=(const AssetFile &);
+
+	MappedFile file;
+	vector<unsigned char> buffer;
+	const unsigned char *data;
+	size_t size;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/inotify.h>
+#endif
+
+using namespace std;
+
+// Bytes of change records read per poll of a watched directory
+const size_t FILE_WATCHER_BUFFER_SIZE = 64 * 1024;
+
+// Reports the files written under a set of directories, their subdirectories included, without blocking:
+// inotify on Linux, ReadDirectoryChangesW on Windows. Poll() from the thread that called Watch().
+class FileWatcher
+{
+public:
+	FileWatcher()
+	{
+#ifndef _WIN32
+		this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	~FileWatcher()
+	{
+#ifdef _WIN32
+		for (size_t i = 0; i < this->roots.size(); i++)
+		{
+			CancelIo(this->roots[i]->handle);
+			CloseHandle(this->roots[i]->handle);
+			CloseHandle(this->roots[i]->overlapped.hEvent);
+			delete this->roots[i];
+		}
+#else
+		if (this->fd >= 0)
+		{
+			close(this->fd);
+		}
+#endif
+	}
+
+	// Starts watching a directory and everything below it. Returns false if it cannot be watched.
+	bool Watch(const string &directory)
+	{
+#ifdef _WIN32
+		Root *root = new Root();
+		root->path = directory;
+		root->handle = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+		if (root->handle == INVALID_HANDLE_VALUE)
+		{
+			delete root;
+			return false;
+		}
+		memset(&root->overlapped, 0, sizeof(root->overlapped));
+		root->overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+		this->roots.push_back(root);
+		return this->listen(*root);
+#else
+		if (this->fd < 0)
+		{
+			return false;
+		}
+
+		int wd = inotify_add_watch(this->fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd < 0)
+		{
+			return false;
+		}
+		this->directories[wd] = directory;
+
+		// inotify watches one directory at a time
+		vector<string> files, subdirectories;
+		ListDirectory(directory, files, subdirectories);
+		for (size_t i = 0; i < subdirectories.size(); i++)
+		{
+			this->Watch(directory + "/" + subdirectories[i]);
+		}
+		return true;
+#endif
+	}
+
+	// Appends the paths of the files written since the last call, as the watched directory plus the relative path.
+	// A file written in several steps may come more than once.
+	void Poll(vector<string> &changed)
+	{
+#ifdef _WIN32
+		for (size_t i = 0; i < this->roots.size(); i++)
+		{
+			Root &root = *this->roots[i];
+			DWORD bytes = 0;
+			if (!GetOverlappedResult(root.handle, &root.overlapped, &bytes, FALSE))
+			{
+				continue;
+			}
+
+			// No bytes means the changes overflowed the buffer and are lost
+			const unsigned char *record = reinterpret_cast<const unsigned char *>(root.buffer);
+			while (bytes > 0)
+			{
+				const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(record);
+				if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+				{
+					int length = static_cast<int>(info->FileNameLength / sizeof(WCHAR));
+					int size = WideCharToMultiByte(CP_ACP, 0, info->FileName, length, NULL, 0, NULL, NULL);
+					string name(size, '\0');
+					WideCharToMultiByte(CP_ACP, 0, info->FileName, length, &name[0], size, NULL, NULL);
+					changed.push_back(root.path + "/" + name);
+				}
+				if (info->NextEntryOffset == 0)
+				{
+					break;
+				}
+				record += info->NextEntryOffset;
+			}
+
+			this->listen(root);
+		}
+#else
+		if (this->fd < 0)
+		{
+			return;
+		}
+
+		alignas(inotify_event) char buffer[FILE_WATCHER_BUFFER_SIZE];
+		for (;;)
+		{
+			ssize_t bytes = read(this->fd, buffer, sizeof(buffer));
+			if (bytes <= 0)
+			{
+				break;
+			}
+
+			for (char *p = buffer; p < buffer + bytes; p += sizeof(inotify_event) + reinterpret_cast<inotify_event *>(p)->len)
+			{
+				const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+				map<int, string>::const_iterator directory = this->directories.find(event->wd);
+				if (directory == this->directories.end() || event->len == 0)
+				{
+					continue;
+				}
+
+				string path = directory->second + "/" + event->name;
+				if (event->mask & IN_ISDIR)
+				{
+					// Directories created after Watch() are watched too, and the files written in them before are reported
+					if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					{
+						this->Watch(path);
+						vector<string> files, subdirectories;
+						ListDirectory(path, files, subdirectories);
+						for (size_t i = 0; i < files.size(); i++)
+						{
+							changed.push_back(path + "/" + files[i]);
+						}
+					}
+				}
+				else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+				{
+					changed.push_back(path);
+				}
+			}
+		}
+#endif
+	}
+
+private:
+	FileWatcher(const FileWatcher &);
+	FileWatcher &operator=(const FileWatcher &);
+
+#ifdef _WIN32
+	struct Root
+	{
+		string path;
+		HANDLE handle;
+		OVERLAPPED overlapped;
+		DWORD buffer[FILE_WATCHER_BUFFER_SIZE / sizeof(DWORD)];	// DWORD-aligned, as ReadDirectoryChangesW requires
+	};
+
+	vector<Root *> roots;
+
+	// Queues the next asynchronous read of the changes under a root
+	bool listen(Root &root)
+	{
+		ResetEvent(root.overlapped.hEvent);
+		return ReadDirectoryChangesW(root.handle, root.buffer, sizeof(root.buffer), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+			NULL, &root.overlapped, NULL) != 0;
+	}
+#else
+	int fd;
+	map<int, string> directories;	// Path of every watch descriptor
+#endif
+};
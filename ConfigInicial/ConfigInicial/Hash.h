@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#include "AssetPack.h"
+
+// 64-bit MurmurHash2 (MurmurHash64A) of a block of memory, used to find identical content
+uint64_t Hash64(const void *data, size_t length, uint64_t seed = 0)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	uint64_t h = seed ^ (length * m);
+
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	const unsigned char *end = p + (length / 8) * 8;
+	for (; p != end; p += 8)
+	{
+		uint64_t k;
+		memcpy(&k, p, sizeof(k));
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	switch (length & 7)
+	{
+	case 7: h ^= uint64_t(p[6]) << 48;
+	case 6: h ^= uint64_t(p[5]) << 40;
+	case 5: h ^= uint64_t(p[4]) << 32;
+	case 4: h ^= uint64_t(p[3]) << 24;
+	case 3: h ^= uint64_t(p[2]) << 16;
+	case 2: h ^= uint64_t(p[1]) << 8;
+	case 1: h ^= uint64_t(p[0]);
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+// Hash of the whole contents of a file, 0 if it cannot be read
+uint64_t HashFile(const std::string &path)
+{
+	AssetFile file;
+	if (!file.Open(path))
+	{
+		return 0;
+	}
+
+	return Hash64(file.Data(), file.Size(), file.Size());
+}
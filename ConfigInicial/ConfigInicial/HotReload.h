@@ -0,0 +1,368 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+
+#include "FileWatcher.h"
+#include "Model.h"
+#include "LazyModel.h"
+#include "Shader.h"
+#include "TextureRegistry.h"
+#include "ThreadPool.h"
+#include "UniformBlocks.h"
+
+using namespace std;
+
+// Seconds a file must go without further writes before it is reloaded, so an editor saving in several steps
+// triggers one reload of the finished file
+const double HOT_RELOAD_SETTLE_TIME = 0.25;
+
+// Reloads the models, textures and shaders whose files change while the program runs. Models are imported again
+// on the worker pool and swapped in by Update() between two frames, textures are decoded again into the same
+// texture by the TextureLoader (into a new one if other files share it, see TextureRegistry::Reload), shaders are
+// rebuilt and kept only if they compile. Everything else stays as it is.
+// Only loose files are watched, so the asset pack must not be mounted.
+class HotReload
+{
+public:
+	~HotReload()
+	{
+		// Imports still running write into the models being reloaded
+		ThreadPool::Shared().Wait();
+	}
+
+	// Reloads the model when its OBJ or an MTL next to it changes
+	void WatchModel(Model &model)
+	{
+		this->watchModel(&model, NULL, model.Path());
+	}
+
+	// Same for a model loaded on demand, which is reloaded only once it is loaded: a later load reads the new files
+	void WatchModel(LazyModel &model)
+	{
+		this->watchModel(NULL, &model, model.Path());
+	}
+
+	// Rebuilds the shader when one of its two files changes
+	void WatchShader(Shader &shader, const string &vertexPath, const string &fragmentPath)
+	{
+		WatchedShader watched;
+		watched.shader = &shader;
+		watched.vertexPath = vertexPath;
+		watched.fragmentPath = fragmentPath;
+		this->shaders.push_back(watched);
+	}
+
+	// Starts watching a directory and everything below it
+	bool Start(const string &directory)
+	{
+		if (!this->watcher.Watch(directory))
+		{
+			cout << "ERROR::HOT_RELOAD::CANNOT_WATCH " << directory << endl;
+			return false;
+		}
+		cout << "HOT_RELOAD::WATCHING " << directory << endl;
+		return true;
+	}
+
+	// Starts the reloads of the files that settled and swaps in the models whose import finished.
+	// Call once per frame on the GL context thread, before the TextureLoader's Update().
+	void Update()
+	{
+		double now = this->seconds();
+
+		vector<string> changed;
+		this->watcher.Poll(changed);
+		for (size_t i = 0; i < changed.size(); i++)
+		{
+			this->settling[NormalizePath(changed[i])] = now;
+		}
+
+		for (map<string, double>::iterator it = this->settling.begin(); it != this->settling.end();)
+		{
+			if (now - it->second >= HOT_RELOAD_SETTLE_TIME && this->reload(it->first, now))
+			{
+				it = this->settling.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		this->finishModels();
+		this->finishTextures(now);
+	}
+
+private:
+	struct WatchedModel
+	{
+		Model *model;
+		LazyModel *lazy;			// Instead of model, for one loaded on demand
+		string key;					// Normalized path of the OBJ
+		string directory;			// Normalized directory, where its MTL files are
+	};
+
+	struct WatchedShader
+	{
+		Shader *shader;
+		string vertexPath;
+		string fragmentPath;
+	};
+
+	struct ModelReload
+	{
+		Model *target;
+		shared_ptr<Model> fresh;			// Imported on the worker pool
+		shared_ptr<atomic<bool> > imported;
+		double start;
+	};
+
+	struct TextureReload
+	{
+		GLuint textureID;
+		string path;
+		double start;
+	};
+
+	FileWatcher watcher;
+	vector<WatchedModel> models;
+	vector<WatchedShader> shaders;
+	map<string, double> settling;		// Changed file, time of its last write
+	vector<ModelReload> modelReloads;
+	vector<TextureReload> textureReloads;
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	void watchModel(Model *model, LazyModel *lazy, const string &path)
+	{
+		WatchedModel watched;
+		watched.model = model;
+		watched.lazy = lazy;
+		watched.key = NormalizePath(path);
+		watched.directory = NormalizePath(path.substr(0, path.find_last_of('/')));
+		this->models.push_back(watched);
+	}
+
+	// The model to reload, or NULL if it is not loaded yet
+	static Model *target(const WatchedModel &watched)
+	{
+		return watched.lazy ? watched.lazy->Loaded() : watched.model;
+	}
+
+	double seconds() const
+	{
+		return chrono::duration<double>(chrono::steady_clock::now() - this->startTime).count();
+	}
+
+	static bool endsWith(const string &text, const string &suffix)
+	{
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	static bool isImage(const string &path)
+	{
+		const char *extensions[] = { ".jpg", ".jpeg", ".png", ".tga", ".bmp" };
+		for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+		{
+			if (endsWith(path, extensions[i]))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Starts reloading whatever uses a changed file. Returns false to be asked again later, while a model it
+	// concerns is still being reloaded from an earlier change.
+	bool reload(const string &path, double now)
+	{
+		// The caches the loaders write next to the sources change too, and are not reloaded
+		bool obj = endsWith(path, ".obj"), mtl = endsWith(path, ".mtl");
+		if (obj || mtl)
+		{
+			for (size_t i = 0; i < this->models.size(); i++)
+			{
+				const WatchedModel &watched = this->models[i];
+				if ((obj && watched.key == path) || (mtl && path.compare(0, watched.directory.size() + 1, watched.directory + "/") == 0))
+				{
+					Model *model = target(watched);
+					if (model && this->reloading(model))
+					{
+						return false;
+					}
+				}
+			}
+			for (size_t i = 0; i < this->models.size(); i++)
+			{
+				const WatchedModel &watched = this->models[i];
+				if ((obj && watched.key == path) || (mtl && path.compare(0, watched.directory.size() + 1, watched.directory + "/") == 0))
+				{
+					Model *model = target(watched);
+					if (model)
+					{
+						this->startModel(*model, now);
+					}
+				}
+			}
+		}
+		else if (isImage(path))
+		{
+			// Models using the image, reloaded if it gets a texture of its own
+			vector<Model *> users;
+			for (size_t i = 0; i < this->models.size(); i++)
+			{
+				Model *model = target(this->models[i]);
+				if (model && model->UsesTexture(path))
+				{
+					if (this->reloading(model))
+					{
+						return false;
+					}
+					users.push_back(model);
+				}
+			}
+
+			bool split;
+			GLuint textureID = TextureRegistry::Instance().Reload(path, split);
+			if (textureID)
+			{
+				TextureReload texture;
+				texture.textureID = textureID;
+				texture.path = path;
+				texture.start = now;
+				this->textureReloads.push_back(texture);
+			}
+
+			// The other paths of a texture shared by content keep the old image. The models using this one are
+			// imported again, their materials then pick up the new texture from the registry.
+			if (split)
+			{
+				for (size_t i = 0; i < users.size(); i++)
+				{
+					this->startModel(*users[i], now);
+				}
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < this->shaders.size(); i++)
+			{
+				WatchedShader &watched = this->shaders[i];
+				if (path != NormalizePath(watched.vertexPath) && path != NormalizePath(watched.fragmentPath))
+				{
+					continue;
+				}
+
+				bool rebuilt = watched.shader->Reload(watched.vertexPath.c_str(), watched.fragmentPath.c_str());
+				ostringstream log;
+				if (rebuilt)
+				{
+					MaterialRegistry::SetSamplers(*watched.shader);
+					FrameUniforms::BindBlocks(*watched.shader);
+					log << "HOT_RELOAD::SHADER " << watched.vertexPath << " + " << watched.fragmentPath << " " << (this->seconds() - now) * 1000.0 << " ms" << endl;
+				}
+				else
+				{
+					log << "ERROR::HOT_RELOAD::SHADER_KEPT " << watched.vertexPath << " + " << watched.fragmentPath << endl;
+				}
+				cout << log.str();
+			}
+		}
+
+		return true;
+	}
+
+	bool reloading(const Model *model) const
+	{
+		for (size_t i = 0; i < this->modelReloads.size(); i++)
+		{
+			if (this->modelReloads[i].target == model)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void startModel(Model &model, double now)
+	{
+		ModelReload reload;
+		reload.target = &model;
+		reload.fresh = make_shared<Model>();
+		reload.imported = make_shared<atomic<bool> >(false);
+		reload.start = now;
+		this->modelReloads.push_back(reload);
+
+		shared_ptr<Model> fresh = reload.fresh;
+		shared_ptr<atomic<bool> > imported = reload.imported;
+		string path = model.Path();
+		ThreadPool::Shared().Submit([fresh, imported, path]
+		{
+			fresh->Import(path);
+			*imported = true;
+		});
+	}
+
+	// Uploads the models whose import finished and swaps them in. A failed import leaves the model as it was.
+	void finishModels()
+	{
+		for (size_t i = 0; i < this->modelReloads.size();)
+		{
+			ModelReload &reload = this->modelReloads[i];
+			if (!*reload.imported)
+			{
+				i++;
+				continue;
+			}
+
+			reload.fresh->Upload();
+			ostringstream log;
+			if (reload.fresh->GpuBytes() > 0)
+			{
+				reload.target->Replace(*reload.fresh);
+				log << "HOT_RELOAD::MODEL " << reload.target->Path() << " " << (this->seconds() - reload.start) * 1000.0 << " ms" << endl;
+			}
+			else
+			{
+				log << "ERROR::HOT_RELOAD::MODEL_KEPT " << reload.target->Path() << endl;
+			}
+			cout << log.str();
+
+			// Releases the replaced meshes' textures, or the failed import's
+			this->modelReloads.erase(this->modelReloads.begin() + i);
+		}
+	}
+
+	// Logs the textures whose new image is on the GPU
+	void finishTextures(double now)
+	{
+		for (size_t i = 0; i < this->textureReloads.size();)
+		{
+			const TextureReload &reload = this->textureReloads[i];
+			TextureInfo info;
+			if (!TextureLoader::Instance().GetInfo(reload.textureID, info) || (info.gpuBytes == 0 && info.width > 0))
+			{
+				i++;
+				continue;
+			}
+
+			ostringstream log;
+			if (info.width > 0)
+			{
+				log << "HOT_RELOAD::TEXTURE " << reload.path << " " << (now - reload.start) * 1000.0 << " ms" << endl;
+			}
+			else
+			{
+				log << "ERROR::HOT_RELOAD::TEXTURE_KEPT " << reload.path << endl;
+			}
+			cout << log.str();
+			this->textureReloads.erase(this->textureReloads.begin() + i);
+		}
+	}
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Model.h"
+#include "Shader.h"
+
+using namespace std;
+
+// Gathers the instances of the models drawn in a frame and draws those of each model and level of detail together,
+// one instanced draw per mesh instead of one draw per mesh and instance. Only used on the GL context thread.
+class InstanceBatcher
+{
+public:
+	static InstanceBatcher &Instance()
+	{
+		static InstanceBatcher batcher;
+		return batcher;
+	}
+
+	// Queues an instance of a model, drawn at the given level of detail with this model matrix on the next Flush()
+	void Add(Model &model, GLuint lod, const glm::mat4 &modelMatrix)
+	{
+		for (size_t i = 0; i < this->batches.size(); i++)
+		{
+			if (this->batches[i].model == &model && this->batches[i].lod == lod)
+			{
+				this->batches[i].modelMatrices.push_back(modelMatrix);
+				return;
+			}
+		}
+
+		Batch batch;
+		batch.model = &model;
+		batch.lod = lod;
+		batch.modelMatrices.push_back(modelMatrix);
+		this->batches.push_back(batch);
+	}
+
+	// Draws the queued instances with a shader reading the model matrix per instance, and empties the queue.
+	// The batches stay, so the next frames reuse their memory.
+	void Flush(Shader &shader)
+	{
+		for (size_t i = 0; i < this->batches.size(); i++)
+		{
+			Batch &batch = this->batches[i];
+			batch.model->DrawInstanced(shader, batch.lod, batch.modelMatrices.data(), static_cast<GLsizei>(batch.modelMatrices.size()));
+			batch.modelMatrices.clear();
+		}
+	}
+
+private:
+	struct Batch
+	{
+		Model *model;
+		GLuint lod;
+		vector<glm::mat4> modelMatrices;
+	};
+
+	vector<Batch> batches;
+
+	InstanceBatcher()
+	{
+	}
+
+	InstanceBatcher(const InstanceBatcher &);
+	InstanceBatcher &operator=(const InstanceBatcher &);
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+using namespace std;
+
+// First of the four attribute locations, one per column, of the per-instance model matrix (see lighting_instanced.vs)
+const GLuint INSTANCE_MATRIX_LOCATION = 3;
+
+// Process-wide vertex buffer of model matrices, one per instance, read by instanced draws. Every mesh's vertex
+// array points its instance attributes at it once, so an instanced draw only has to upload the matrices.
+// Only used on the GL context thread.
+class InstanceBuffer
+{
+public:
+	static InstanceBuffer &Instance()
+	{
+		static InstanceBuffer instances;
+		return instances;
+	}
+
+	// Points the instance attributes of the bound vertex array at the buffer, advancing once per instance
+	void SetupAttributes()
+	{
+		if (!this->buffer)
+		{
+			this->create();
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid *)(column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+		}
+	}
+
+	// Replaces the matrices with those of the next instanced draws. The old storage is orphaned rather than
+	// overwritten, so draws still reading it do not stall the upload.
+	void Upload(const glm::mat4 *matrices, GLsizei count)
+	{
+		if (!this->buffer)
+		{
+			this->create();
+		}
+
+		GLsizeiptr bytes = count * sizeof(glm::mat4);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+		if (bytes > this->capacity)
+		{
+			this->capacity = bytes;
+		}
+		glBufferData(GL_ARRAY_BUFFER, this->capacity, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, matrices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+private:
+	GLuint buffer;
+	GLsizeiptr capacity;
+
+	InstanceBuffer() : buffer(0), capacity(0)
+	{
+	}
+
+	InstanceBuffer(const InstanceBuffer &);
+	InstanceBuffer &operator=(const InstanceBuffer &);
+
+	// Starts with one identity matrix, so the attributes hold valid data for the draws that are not instanced
+	void create()
+	{
+		glm::mat4 identity(1.0f);
+		glGenBuffers(1, &this->buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(identity), &identity[0][0], GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		this->capacity = sizeof(identity);
+	}
+};
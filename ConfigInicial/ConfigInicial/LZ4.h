@@ -0,0 +1,196 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+using namespace std;
+
+// LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md): sequences of a token, literals and
+// a back-reference of at least 4 bytes up to 64 KB behind. Compressed blocks are readable by any LZ4 decoder.
+const size_t LZ4_MIN_MATCH = 4;
+// The last 5 bytes are always literals and the last match starts at least 12 bytes before the end
+const size_t LZ4_LAST_LITERALS = 5;
+const size_t LZ4_MATCH_FIND_LIMIT = 12;
+const size_t LZ4_MAX_DISTANCE = 65535;
+// Entries of the match finder's hash table, indexed by a hash of the next 4 bytes
+const int LZ4_HASH_BITS = 16;
+
+uint32_t lz4Read32(const unsigned char *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+uint32_t lz4Hash(uint32_t sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Length that does not fit in a token nibble: runs of 255 and the remainder
+void lz4WriteLength(vector<unsigned char> &out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+	{
+		out.push_back(255);
+	}
+	out.push_back(static_cast<unsigned char>(length));
+}
+
+// One sequence: literals then a match of matchLength bytes at distance back, or only literals for the last one
+void lz4WriteSequence(vector<unsigned char> &out, const unsigned char *literals, size_t literalLength, size_t distance, size_t matchLength)
+{
+	size_t matchCode = matchLength ? matchLength - LZ4_MIN_MATCH : 0;
+	out.push_back(static_cast<unsigned char>(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+	if (literalLength >= 15)
+	{
+		lz4WriteLength(out, literalLength - 15);
+	}
+	out.insert(out.end(), literals, literals + literalLength);
+
+	if (matchLength)
+	{
+		out.push_back(static_cast<unsigned char>(distance));
+		out.push_back(static_cast<unsigned char>(distance >> 8));
+		if (matchCode >= 15)
+		{
+			lz4WriteLength(out, matchCode - 15);
+		}
+	}
+}
+
+// Compresses a block with a greedy single-probe match finder: fast rather than small, as the loaders only decompress
+void LZ4Compress(const unsigned char *source, size_t size, vector<unsigned char> &out)
+{
+	out.clear();
+	out.reserve(size + size / 255 + 16);
+
+	// Positions plus one, 0 being an empty slot
+	vector<uint32_t> table(size_t(1) << LZ4_HASH_BITS, 0);
+	size_t anchor = 0;
+	if (size > LZ4_MATCH_FIND_LIMIT)
+	{
+		size_t matchLimit = size - LZ4_LAST_LITERALS;
+		size_t position = 0;
+		while (position + LZ4_MATCH_FIND_LIMIT <= size)
+		{
+			uint32_t sequence = lz4Read32(source + position);
+			uint32_t &slot = table[lz4Hash(sequence)];
+			size_t candidate = slot;
+			slot = static_cast<uint32_t>(position + 1);
+			if (candidate == 0 || position - (candidate - 1) > LZ4_MAX_DISTANCE || lz4Read32(source + candidate - 1) != sequence)
+			{
+				position++;
+				continue;
+			}
+
+			size_t match = candidate - 1;
+			size_t length = LZ4_MIN_MATCH;
+			while (position + length < matchLimit && source[match + length] == source[position + length])
+			{
+				length++;
+			}
+			// Take in the literals before that also match
+			while (position > anchor && match > 0 && source[position - 1] == source[match - 1])
+			{
+				position--;
+				match--;
+				length++;
+			}
+
+			lz4WriteSequence(out, source + anchor, position - anchor, position - match, length);
+			position += length;
+			anchor = position;
+		}
+	}
+
+	lz4WriteSequence(out, source + anchor, size - anchor, 0, 0);
+}
+
+// Decompresses a block into exactly size bytes. Returns false on corrupt input instead of reading or writing out of bounds.
+bool LZ4Decompress(const unsigned char *source, size_t sourceSize, unsigned char *result, size_t size)
+{
+	size_t in = 0, out = 0;
+	while (in < sourceSize)
+	{
+		unsigned char token = source[in++];
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15)
+		{
+			unsigned char extra;
+			do
+			{
+				if (in >= sourceSize)
+				{
+					return false;
+				}
+				extra = source[in++];
+				literalLength += extra;
+			} while (extra == 255);
+		}
+		if (literalLength > sourceSize - in || literalLength > size - out)
+		{
+			return false;
+		}
+		memcpy(result + out, source + in, literalLength);
+		in += literalLength;
+		out += literalLength;
+
+		// The last sequence has no match
+		if (in == sourceSize)
+		{
+			break;
+		}
+
+		if (sourceSize - in < 2)
+		{
+			return false;
+		}
+		size_t distance = source[in] | (size_t(source[in + 1]) << 8);
+		in += 2;
+		if (distance == 0 || distance > out)
+		{
+			return false;
+		}
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15)
+		{
+			unsigned char extra;
+			do
+			{
+				if (in >= sourceSize)
+				{
+					return false;
+				}
+				extra = source[in++];
+				matchLength += extra;
+			} while (extra == 255);
+		}
+		matchLength += LZ4_MIN_MATCH;
+		if (matchLength > size - out)
+		{
+			return false;
+		}
+
+		// A match may overlap the bytes it produces (a run), so it is copied forward byte by byte then
+		const unsigned char *match = result + out - distance;
+		if (distance >= matchLength)
+		{
+			memcpy(result + out, match, matchLength);
+		}
+		else
+		{
+			for (size_t i = 0; i < matchLength; i++)
+			{
+				result[out + i] = match[i];
+			}
+		}
+		out += matchLength;
+	}
+
+	return out == size;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <chrono>
+
+#include "Model.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Handle to a model that is only loaded once something asks for it. Prefetch() starts the import on the worker
+// pool ahead of time; Get() starts it too if needed and returns the model once it is uploaded, so a model that is
+// never drawn costs neither load time nor memory.
+class LazyModel
+{
+public:
+	explicit LazyModel(const string &path) : path(path), state(LAZY_MODEL_UNLOADED)
+	{
+	}
+
+	// Starts importing the model in the background unless it is loading or loaded already
+	void Prefetch()
+	{
+		if (this->state != LAZY_MODEL_UNLOADED)
+		{
+			return;
+		}
+
+		this->state = LAZY_MODEL_IMPORTING;
+		this->requestTime = chrono::high_resolution_clock::now();
+		this->model = make_shared<Model>();
+		this->imported = make_shared<atomic<bool> >(false);
+
+		// The task keeps the model alive even if the handle goes away first
+		shared_ptr<Model> model = this->model;
+		shared_ptr<atomic<bool> > imported = this->imported;
+		string path = this->path;
+		ThreadPool::Shared().Submit([model, imported, path]
+		{
+			model->Import(path);
+			*imported = true;
+		});
+	}
+
+	// Returns the model if it is loaded, nullptr while it is not. The first call starts loading it, a call after
+	// the import finished uploads it. Must be called on the GL context thread.
+	Model *Get()
+	{
+		this->Prefetch();
+		if (this->state == LAZY_MODEL_IMPORTING && *this->imported)
+		{
+			this->model->Upload();
+			this->state = LAZY_MODEL_LOADED;
+
+			ostringstream log;
+			log << "MODEL::LAZY:: " << this->path << " loaded "
+				<< chrono::duration<float, milli>(chrono::high_resolution_clock::now() - this->requestTime).count() << " ms after it was requested" << endl;
+			cout << log.str();
+		}
+		return this->Loaded();
+	}
+
+	// The model if it is loaded already, without starting anything
+	Model *Loaded() const
+	{
+		return this->state == LAZY_MODEL_LOADED ? this->model.get() : nullptr;
+	}
+
+	const string &Path() const
+	{
+		return this->path;
+	}
+
+private:
+	enum State
+	{
+		LAZY_MODEL_UNLOADED,
+		LAZY_MODEL_IMPORTING,
+		LAZY_MODEL_LOADED
+	};
+
+	string path;
+	State state;
+	shared_ptr<Model> model;
+	shared_ptr<atomic<bool> > imported;
+	chrono::high_resolution_clock::time_point requestTime;
+};
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cctype>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+// Size and modification time of a file on disk, used to key caches against their source file
+struct FileStamp
+{
+	int64_t size;
+	int64_t mtime;
+};
+
+// Fills the stamp of the given file. Returns false if the file does not exist.
+bool GetFileStamp(const std::string &path, FileStamp &stamp)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0)
+	{
+		return false;
+	}
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+	{
+		return false;
+	}
+#endif
+	stamp.size = static_cast<int64_t>(st.st_size);
+	stamp.mtime = static_cast<int64_t>(st.st_mtime);
+	return true;
+}
+
+// Canonical form of a path: forward slashes, no "." or ".." segments, case-insensitive on Windows
+std::string NormalizePath(const std::string &path)
+{
+	std::vector<std::string> segments;
+	std::string segment;
+	for (size_t i = 0; i <= path.size(); i++)
+	{
+		char c = i < path.size() ? path[i] : '/';
+		if (c != '/' && c != '\\')
+		{
+#ifdef _WIN32
+			c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+#endif
+			segment += c;
+			continue;
+		}
+
+		if (segment == "..")
+		{
+			if (!segments.empty() && segments.back() != "..")
+			{
+				segments.pop_back();
+			}
+			else
+			{
+				segments.push_back(segment);
+			}
+		}
+		else if (!segment.empty() && segment != ".")
+		{
+			segments.push_back(segment);
+		}
+		segment.clear();
+	}
+
+	std::string normalized = (!path.empty() && (path[0] == '/' || path[0] == '\\')) ? "/" : "";
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		normalized += (i > 0 ? "/" : "") + segments[i];
+	}
+	return normalized;
+}
+
+// Writes a whole file aside and renames it over the destination, so a crash never leaves a torn file behind
+bool WriteFileAtomic(const std::string &path, const void *data, size_t size)
+{
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out.write(static_cast<const char *>(data), size))
+		{
+			return false;
+		}
+	}
+
+	remove(path.c_str());
+	if (rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// Names of the regular files and of the subdirectories of a directory, without "." and "..".
+// Returns false if the directory cannot be read.
+bool ListDirectory(const std::string &path, std::vector<std::string> &files, std::vector<std::string> &directories)
+{
+	files.clear();
+	directories.clear();
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((path + "/*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	do
+	{
+		std::string name = entry.cFileName;
+		if (name == "." || name == "..")
+		{
+			continue;
+		}
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			directories.push_back(name);
+		}
+		else
+		{
+			files.push_back(name);
+		}
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR *dir = opendir(path.c_str());
+	if (!dir)
+	{
+		return false;
+	}
+	while (struct dirent *entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+		{
+			continue;
+		}
+		struct stat st;
+		if (stat((path + "/" + name).c_str(), &st) != 0)
+		{
+			continue;
+		}
+		if (S_ISDIR(st.st_mode))
+		{
+			directories.push_back(name);
+		}
+		else if (S_ISREG(st.st_mode))
+		{
+			files.push_back(name);
+		}
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+// Read-only memory mapping of a whole file. The mapping stays valid until Close() or destruction.
+class MappedFile
+{
+public:
+	MappedFile() : data(nullptr), size(0)
+	{
+#ifdef _WIN32
+		this->file = INVALID_HANDLE_VALUE;
+		this->mapping = NULL;
+#endif
+	}
+
+	~MappedFile()
+	{
+		this->Close();
+	}
+
+	// Maps the file at the given path. Returns false if it cannot be opened or is empty.
+	bool Open(const std::string &path)
+	{
+		this->Close();
+#ifdef _WIN32
+		this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (this->file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			this->Close();
+			return false;
+		}
+
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->mapping == NULL)
+		{
+			this->Close();
+			return false;
+		}
+
+		this->data = static_cast<const unsigned char *>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+		this->size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		void *address = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping keeps its own reference to the file
+		close(fd);
+		if (address == MAP_FAILED)
+		{
+			return false;
+		}
+
+		this->data = static_cast<const unsigned char *>(address);
+		this->size = static_cast<size_t>(st.st_size);
+#endif
+		if (!this->data)
+		{
+			this->Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (this->data)
+		{
+			UnmapViewOfFile(this->data);
+		}
+		if (this->mapping != NULL)
+		{
+			CloseHandle(this->mapping);
+		}
+		if (this->file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(this->file);
+		}
+		this->file = INVALID_HANDLE_VALUE;
+		this->mapping = NULL;
+#else
+		if (this->data)
+		{
+			munmap(const_cast<unsigned char *>(this->data), this->size);
+		}
+#endif
+		this->data = nullptr;
+		this->size = 0;
+	}
+
+	bool IsOpen() const
+	{
+		return this->data != nullptr;
+	}
+
+	const unsigned char *Data() const
+	{
+		return this->data;
+	}
+
+	size_t Size() const
+	{
+		return this->size;
+	}
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include "Shader.h"
+#include "TextureBindings.h"
+
+using namespace std;
+
+// Texture units of the material textures: diffuse ones first, then specular ones. lighting.frag samples the first
+// of each, material.diffuse and material.specular.
+const GLuint MATERIAL_DIFFUSE_UNITS = 2;
+const GLuint MATERIAL_SPECULAR_UNITS = 2;
+const GLuint MATERIAL_MAX_TEXTURES = MATERIAL_DIFFUSE_UNITS + MATERIAL_SPECULAR_UNITS;
+
+// Index of a Material in the MaterialRegistry
+typedef GLuint MaterialID;
+
+// Textures a mesh is drawn with and the units they go to, resolved once when the mesh is created
+struct Material
+{
+	GLuint textureCount;
+	GLuint units[MATERIAL_MAX_TEXTURES];
+	GLuint textures[MATERIAL_MAX_TEXTURES];
+};
+
+// Process-wide list of materials. Meshes with the same textures share one ID, so sorting by it groups them and
+// drawing them in a row binds nothing new. Materials do not own their textures, the models do.
+// Only used on the GL context thread.
+class MaterialRegistry
+{
+public:
+	static MaterialRegistry &Instance()
+	{
+		static MaterialRegistry registry;
+		return registry;
+	}
+
+	// ID of the material with these textures, by sampler type ("texture_diffuse" or "texture_specular") in
+	// the order the sampler numbers go. Textures beyond the units of their type are left out. A material without
+	// a specular texture samples its first diffuse one there too, as when both samplers read unit 0.
+	MaterialID Acquire(const vector<string> &types, const vector<GLuint> &textures)
+	{
+		Material material;
+		memset(&material, 0, sizeof(material));
+		GLuint diffuse = 0, specular = 0;
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			GLuint unit;
+			if (types[i] == "texture_diffuse" && diffuse < MATERIAL_DIFFUSE_UNITS)
+			{
+				unit = diffuse++;
+			}
+			else if (types[i] == "texture_specular" && specular < MATERIAL_SPECULAR_UNITS)
+			{
+				unit = MATERIAL_DIFFUSE_UNITS + specular++;
+			}
+			else
+			{
+				cout << "ERROR::MATERIAL::NO_UNIT_FOR " << types[i] << endl;
+				continue;
+			}
+			material.units[material.textureCount] = unit;
+			material.textures[material.textureCount] = textures[i];
+			material.textureCount++;
+		}
+		if (specular == 0 && diffuse > 0)
+		{
+			material.units[material.textureCount] = MATERIAL_DIFFUSE_UNITS;
+			material.textures[material.textureCount] = material.textures[0];
+			material.textureCount++;
+		}
+
+		string key(reinterpret_cast<const char *>(&material), sizeof(material));
+		map<string, MaterialID>::const_iterator found = this->ids.find(key);
+		if (found != this->ids.end())
+		{
+			return found->second;
+		}
+
+		MaterialID id = static_cast<MaterialID>(this->materials.size());
+		this->materials.push_back(material);
+		this->ids[key] = id;
+		return id;
+	}
+
+	const Material &Get(MaterialID id) const
+	{
+		return this->materials[id];
+	}
+
+	// Binds the textures of a material, and no texture to the units it leaves empty so they do not show what the
+	// previous draw left there. Those already bound are skipped.
+	void Bind(MaterialID id) const
+	{
+		const Material &material = this->materials[id];
+		GLuint textures[MATERIAL_MAX_TEXTURES] = { 0 };
+		for (GLuint i = 0; i < material.textureCount; i++)
+		{
+			textures[material.units[i]] = material.textures[i];
+		}
+		for (GLuint unit = 0; unit < MATERIAL_MAX_TEXTURES; unit++)
+		{
+			TextureBindings::Instance().Bind(unit, textures[unit]);
+		}
+	}
+
+	// Points the material samplers of a program at the units of the first diffuse and specular textures. Once per
+	// program, after it is (re)built. Programs without material.diffuse, like the shadow pass, are left alone.
+	static void SetSamplers(Shader &shader)
+	{
+		UniformID diffuse = shader.Uniform("material.diffuse");
+		UniformID specular = shader.Uniform("material.specular");
+		if (diffuse < 0)
+		{
+			return;
+		}
+		if (specular < 0)
+		{
+			cout << "ERROR::MATERIAL::NO_SAMPLER material.specular" << endl;
+		}
+
+		GLint previous = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+		glUseProgram(shader.Program);
+		shader.set(diffuse, static_cast<GLint>(0));
+		shader.set(specular, static_cast<GLint>(MATERIAL_DIFFUSE_UNITS));
+		glUseProgram(previous);
+	}
+
+private:
+	vector<Material> materials;
+	map<string, MaterialID> ids;		// Bytes of every material, to find it again
+
+	MaterialRegistry()
+	{
+		// ID 0: no textures
+		this->Acquire(vector<string>(), vector<GLuint>());
+	}
+
+	MaterialRegistry(const MaterialRegistry &);
+	MaterialRegistry &operator=(const MaterialRegistry &);
+};
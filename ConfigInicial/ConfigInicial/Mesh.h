@@ -5,17 +5,21 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <utility>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
-
+#include <glm/packing.hpp>
 
 #include "Shader.h"
+#include "Meshlet.h"
+#include "RenderStats.h"
+#include "TextureBindings.h"
+#include "Material.h"
+#include "MeshRegistry.h"
+#include "InstanceBuffer.h"
+#include "Hash.h"
 
 using namespace std;
 
@@ -29,88 +33,329 @@ struct Vertex
 	glm::vec2 TexCoords;
 };
 
-struct Texture
+// Compact GPU vertex, 16 bytes instead of 32. The shader dequantizes it (see lighting.vs).
+struct PackedVertex
+{
+	// Position, unorm16 relative to the mesh bounds (w unused)
+	GLushort Position[4];
+	// Normal, octahedral-encoded snorm16
+	GLshort Normal[2];
+	// TexCoords, two half floats
+	GLuint TexCoords;
+};
+
+// Levels of detail a mesh can have, LOD0 being the full mesh
+const GLuint MESH_LOD_MAX = 4;
+
+// Layout of the vertex buffer a Mesh uploads
+enum VertexFormat
 {
-	GLuint id;
-	string type;
-	aiString path;
+	VERTEX_FORMAT_FLOAT,
+	VERTEX_FORMAT_QUANTIZED
 };
 
 class Mesh
 {
 public:
 	/*  Mesh Data  */
-	vector<Vertex> vertices;
+	vector<Vertex> vertices;			// Empty once ReleaseGeometry() dropped them, the GPU has its own copy
 	vector<GLuint> indices;
-	vector<Texture> textures;
+	MaterialID material;				// Textures it is drawn with, see Material.h
 
 	/*  Functions  */
-	// Constructor
-	Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures)
+	// Constructor. lodOffsets is the first index of every level of detail (see MeshSimplifier.h), empty for a single level.
+	// meshlets split LOD0 into clusters culled one by one, empty to always draw LOD0 whole.
+	Mesh(vector<Vertex> vertices, vector<GLuint> indices, MaterialID material, vector<GLuint> lodOffsets = vector<GLuint>(),
+		vector<Meshlet> meshlets = vector<Meshlet>())
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = move(vertices);
+		this->indices = move(indices);
+		this->material = material;
+		this->lodOffsets = move(lodOffsets);
+		this->meshlets = move(meshlets);
 
 		// Now that we have all the required data, set the vertex buffers and its attribute pointers.
-		this->setupMesh();
+		this->setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
 	}
 
-	// Render the mesh
-	void Draw(Shader shader)
+	// Constructor from raw arrays, e.g. the memory-mapped contents of a mesh cache. The buffers are filled
+	// straight from them; they are only copied into vertices and indices when keepGeometry is set.
+	Mesh(const Vertex *vertices, GLuint vertexCount, const GLuint *indices, GLuint indexCount, MaterialID material,
+		const GLuint *lodOffsets = nullptr, GLuint lodCount = 0, const Meshlet *meshlets = nullptr, GLuint meshletCount = 0,
+		bool keepGeometry = true)
 	{
-		// Bind appropriate textures
-		GLuint diffuseNr = 1;
-		GLuint specularNr = 1;
-
-		for (GLuint i = 0; i < this->textures.size(); i++)
+		if (keepGeometry)
+		{
+			this->vertices.assign(vertices, vertices + vertexCount);
+			this->indices.assign(indices, indices + indexCount);
+		}
+		this->material = material;
+		if (lodOffsets)
+		{
+			this->lodOffsets.assign(lodOffsets, lodOffsets + lodCount);
+		}
+		if (meshlets)
 		{
-			glActiveTexture(GL_TEXTURE0 + i); // Active proper texture unit before binding
-											  // Retrieve texture number (the N in diffuse_textureN)
-			stringstream ss;
-			string number;
-			string name = this->textures[i].type;
+			this->meshlets.assign(meshlets, meshlets + meshletCount);
+		}
 
-			if (name == "texture_diffuse")
-			{
-				ss << diffuseNr++; // Transfer GLuint to stream
-			}
-			else if (name == "texture_specular")
+		this->setupMesh(vertices, vertexCount, indices, indexCount);
+	}
+
+	// Vertex format used by the meshes created from now on
+	static VertexFormat &DefaultFormat()
+	{
+		static VertexFormat format = VERTEX_FORMAT_QUANTIZED;
+		return format;
+	}
+
+	// Render the mesh at the given level of detail, clamped to the levels it has. With a view, LOD0 is drawn
+	// meshlet by meshlet and those outside the frustum or facing away are skipped.
+	void Draw(Shader &shader, GLuint lod = 0, const ClusterView *view = nullptr)
+	{
+		GLuint level = min(lod, this->LodCount() - 1);
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+		// Visible index ranges, neighbouring meshlets merged into one
+		this->drawCounts.clear();
+		this->drawOffsets.clear();
+		GLsizei culled = 0;
+		if (level == 0 && view && !this->meshlets.empty())
+		{
+			GLuint rangeEnd = ~GLuint(0);
+			for (size_t i = 0; i < this->meshlets.size(); i++)
 			{
-				ss << specularNr++; // Transfer GLuint to stream
+				const Meshlet &meshlet = this->meshlets[i];
+				if (!MeshletVisible(meshlet, *view))
+				{
+					culled += meshlet.indexCount;
+					continue;
+				}
+				if (meshlet.firstIndex == rangeEnd)
+				{
+					this->drawCounts.back() += meshlet.indexCount;
+				}
+				else
+				{
+					this->drawCounts.push_back(meshlet.indexCount);
+					this->drawOffsets.push_back((GLvoid *)(meshlet.firstIndex * indexSize));
+				}
+				rangeEnd = meshlet.firstIndex + meshlet.indexCount;
 			}
+		}
+		else
+		{
+			this->drawCounts.push_back(this->lodIndexCount(level));
+			this->drawOffsets.push_back((GLvoid *)(this->lodOffsets[level] * indexSize));
+		}
 
-			number = ss.str();
-			// Now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-			// And finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+		RenderStats::Instance().fullDetailTriangles += this->lodIndexCount(0) / 3;
+		RenderStats::Instance().culledTriangles += culled / 3;
+		if (this->drawCounts.empty())
+		{
+			return;
 		}
 
-		// Also set each mesh's shininess property to a default value (if you want you could extend this to another mesh property and possibly change this value)
-		glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"), 16.0f);
+		this->setDrawState(shader);
 
-		// Draw mesh
+		// Draw mesh: every level and meshlet is a range of the same index buffer
 		glBindVertexArray(this->VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+		if (this->drawCounts.size() == 1)
+		{
+			glDrawElements(GL_TRIANGLES, this->drawCounts[0], this->indexType, this->drawOffsets[0]);
+		}
+		else
+		{
+			glMultiDrawElements(GL_TRIANGLES, this->drawCounts.data(), this->indexType, this->drawOffsets.data(), static_cast<GLsizei>(this->drawCounts.size()));
+		}
 		glBindVertexArray(0);
 
-		// Always good practice to set everything back to defaults once configured.
-		for (GLuint i = 0; i < this->textures.size(); i++)
+		RenderStats::Instance().drawCalls++;
+		for (size_t i = 0; i < this->drawCounts.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glBindTexture(GL_TEXTURE_2D, 0);
+			RenderStats::Instance().triangles += this->drawCounts[i] / 3;
 		}
 	}
 
+	// Draws count instances of the mesh at the given level of detail, their model matrices read from the
+	// InstanceBuffer. Meshlets are not culled, each instance would see others.
+	void DrawInstanced(Shader &shader, GLuint lod, GLsizei count)
+	{
+		GLuint level = min(lod, this->LodCount() - 1);
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		GLsizei indexCount = this->lodIndexCount(level);
+
+		this->setDrawState(shader);
+
+		glBindVertexArray(this->VAO);
+		glDrawElementsInstanced(GL_TRIANGLES, indexCount, this->indexType, (GLvoid *)(this->lodOffsets[level] * indexSize), count);
+		glBindVertexArray(0);
+
+		RenderStats::Instance().drawCalls++;
+		RenderStats::Instance().triangles += indexCount / 3 * count;
+		RenderStats::Instance().fullDetailTriangles += this->lodIndexCount(0) / 3 * count;
+	}
+
+	GLuint LodCount() const
+	{
+		return static_cast<GLuint>(this->lodOffsets.size());
+	}
+
+	GLuint TriangleCount(GLuint lod) const
+	{
+		return lod < this->LodCount() ? this->lodIndexCount(lod) / 3 : 0;
+	}
+
+	// First index of every level of detail in indices
+	const vector<GLuint> &LodOffsets() const
+	{
+		return this->lodOffsets;
+	}
+
+	// Whether vertices and indices still hold the geometry
+	bool HasGeometry() const
+	{
+		return this->vertices.size() == this->vertexCount;
+	}
+
+	// Frees the CPU copy of the vertices and indices once they are on the GPU. The bounds, levels of detail and
+	// meshlets stay, drawing only needs those.
+	void ReleaseGeometry()
+	{
+		vector<Vertex>().swap(this->vertices);
+		vector<GLuint>().swap(this->indices);
+	}
+
+	glm::vec3 BoundsMin() const
+	{
+		return this->boundsMin;
+	}
+
+	glm::vec3 BoundsMax() const
+	{
+		return this->boundsMin + this->boundsExtent;
+	}
+
+	// Drops the buffers of the mesh, deleted once no other mesh shares them. The mesh must not be drawn
+	// afterwards. Must be called on the GL context thread.
+	void Release()
+	{
+		MeshRegistry::Instance().Release(this->VAO);
+		this->VAO = this->VBO = this->EBO = 0;
+	}
+
+	// Bytes the vertex and index buffers of this mesh take on the GPU
+	size_t GpuBytes() const
+	{
+		size_t vertexSize = this->format == VERTEX_FORMAT_QUANTIZED ? sizeof(PackedVertex) : sizeof(Vertex);
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		return this->vertexCount * vertexSize + this->indexCount * indexSize;
+	}
+
+	// Bytes the same mesh takes with full-float vertices and 32-bit indices
+	size_t UnpackedBytes() const
+	{
+		return this->vertexCount * sizeof(Vertex) + this->indexCount * sizeof(GLuint);
+	}
+
+	// Bytes the mesh holds in main memory: its geometry until released, plus what drawing needs
+	size_t CpuBytes() const
+	{
+		return this->vertices.capacity() * sizeof(Vertex) + this->indices.capacity() * sizeof(GLuint)
+			+ this->lodOffsets.capacity() * sizeof(GLuint) + this->meshlets.capacity() * sizeof(Meshlet);
+	}
+
 private:
 	/*  Render data  */
 	GLuint VAO, VBO, EBO;
+	VertexFormat format;
+	GLenum indexType;
+	size_t vertexCount;
+	GLsizei indexCount;
+	vector<GLuint> lodOffsets;
+	vector<Meshlet> meshlets;
+	vector<GLsizei> drawCounts;			// Ranges of the current draw, kept to reuse their storage
+	vector<const GLvoid *> drawOffsets;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsExtent;
 
 	/*  Functions    */
+	// Material and bounds uniforms of a draw of this mesh
+	void setDrawState(Shader &shader) const
+	{
+		// Bind the material's textures to their units, the samplers point there already (MaterialRegistry::SetSamplers)
+		MaterialRegistry::Instance().Bind(this->material);
+
+		// Also set each mesh's shininess property to a default value (if you want you could extend this to another mesh property and possibly change this value)
+		shader.set(shader.meshUniforms.shininess, 16.0f);
+
+		// Bounds the shader needs to dequantize positions
+		shader.set(shader.meshUniforms.quantized, static_cast<GLint>(this->format == VERTEX_FORMAT_QUANTIZED));
+		shader.set(shader.meshUniforms.boundsMin, this->boundsMin);
+		shader.set(shader.meshUniforms.boundsExtent, this->boundsExtent);
+	}
+
 	// Initializes all the buffer objects/arrays
-	void setupMesh()
+	void setupMesh(const Vertex *vertices, size_t vertexCount, const GLuint *indices, size_t indexCount)
 	{
+		this->format = DefaultFormat();
+		this->vertexCount = vertexCount;
+		this->indexCount = static_cast<GLsizei>(indexCount);
+		if (this->lodOffsets.empty())
+		{
+			this->lodOffsets.push_back(0);
+		}
+		// 16-bit indices whenever every vertex can be addressed with them
+		this->indexType = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		this->computeBounds(vertices, vertexCount);
+
+		// The exact data the buffers get, packed vertices and 16-bit indices included
+		// A great thing about structs is that their memory layout is sequential for all its items.
+		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+		// again translates to 3/2 floats which translates to a byte array.
+		vector<PackedVertex> packed;
+		const GLvoid *vertexData = vertices;
+		size_t vertexBytes = vertexCount * sizeof(Vertex);
+		if (this->format == VERTEX_FORMAT_QUANTIZED)
+		{
+			packed.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				packed[i] = this->packVertex(vertices[i]);
+			}
+			vertexData = packed.data();
+			vertexBytes = packed.size() * sizeof(PackedVertex);
+		}
+
+		vector<GLushort> shortIndices;
+		const GLvoid *indexData = indices;
+		size_t indexBytes = indexCount * sizeof(GLuint);
+		if (this->indexType == GL_UNSIGNED_SHORT)
+		{
+			shortIndices.assign(indices, indices + indexCount);
+			indexData = shortIndices.data();
+			indexBytes = shortIndices.size() * sizeof(GLushort);
+		}
+
+		// Another mesh with the same data, layout and dequantization bounds can lend its buffers
+		struct
+		{
+			glm::vec3 boundsMin;
+			glm::vec3 boundsExtent;
+			GLenum format;
+			GLenum indexType;
+		} layout = { this->boundsMin, this->boundsExtent, static_cast<GLenum>(this->format), this->indexType };
+		uint64_t contentHash = Hash64(vertexData, vertexBytes, Hash64(indexData, indexBytes, Hash64(&layout, sizeof(layout))));
+
+		MeshBuffers buffers;
+		if (MeshRegistry::Instance().Acquire(contentHash, vertexBytes, indexBytes, buffers))
+		{
+			this->VAO = buffers.VAO;
+			this->VBO = buffers.VBO;
+			this->EBO = buffers.EBO;
+			return;
+		}
+
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->VAO);
 		glGenBuffers(1, &this->VBO);
@@ -119,25 +364,96 @@ private:
 		glBindVertexArray(this->VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-		// A great thing about structs is that their memory layout is sequential for all its items.
-		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
+
+		if (this->format == VERTEX_FORMAT_QUANTIZED)
+		{
+			// Set the vertex attribute pointers
+			// Vertex Positions, normalized to [0, 1] inside the bounds
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid *)offsetof(PackedVertex, Position));
+			// Vertex Normals, the octahedral xy in [-1, 1]
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid *)offsetof(PackedVertex, Normal));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid *)offsetof(PackedVertex, TexCoords));
+		}
+		else
+		{
+			// Set the vertex attribute pointers
+			// Vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)0);
+			// Vertex Normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)offsetof(Vertex, Normal));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)offsetof(Vertex, TexCoords));
+		}
+
+		// Per-instance model matrix, for DrawInstanced
+		InstanceBuffer::Instance().SetupAttributes();
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *)offsetof(Vertex, TexCoords));
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
 
 		glBindVertexArray(0);
+
+		buffers.VAO = this->VAO;
+		buffers.VBO = this->VBO;
+		buffers.EBO = this->EBO;
+		MeshRegistry::Instance().Add(contentHash, vertexBytes, indexBytes, buffers);
+	}
+
+	GLsizei lodIndexCount(GLuint lod) const
+	{
+		GLsizei end = lod + 1 < this->LodCount() ? static_cast<GLsizei>(this->lodOffsets[lod + 1]) : this->indexCount;
+		return end - static_cast<GLsizei>(this->lodOffsets[lod]);
+	}
+
+	void computeBounds(const Vertex *vertices, size_t vertexCount)
+	{
+		glm::vec3 boundsMax(0.0f);
+		this->boundsMin = glm::vec3(0.0f);
+		if (vertexCount > 0)
+		{
+			this->boundsMin = boundsMax = vertices[0].Position;
+		}
+		for (size_t i = 1; i < vertexCount; i++)
+		{
+			this->boundsMin = glm::min(this->boundsMin, vertices[i].Position);
+			boundsMax = glm::max(boundsMax, vertices[i].Position);
+		}
+
+		// A flat mesh still needs a non-zero extent to be divided by
+		this->boundsExtent = glm::max(boundsMax - this->boundsMin, glm::vec3(1e-6f));
+	}
+
+	PackedVertex packVertex(const Vertex &vertex) const
+	{
+		PackedVertex packed;
+
+		glm::vec3 p = glm::clamp((vertex.Position - this->boundsMin) / this->boundsExtent, 0.0f, 1.0f);
+		packed.Position[0] = static_cast<GLushort>(p.x * 65535.0f + 0.5f);
+		packed.Position[1] = static_cast<GLushort>(p.y * 65535.0f + 0.5f);
+		packed.Position[2] = static_cast<GLushort>(p.z * 65535.0f + 0.5f);
+		packed.Position[3] = 0;
+
+		// Octahedral encoding: project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+		glm::vec3 n = vertex.Normal;
+		float length = fabs(n.x) + fabs(n.y) + fabs(n.z);
+		glm::vec2 e = length > 0.0f ? glm::vec2(n.x, n.y) / length : glm::vec2(0.0f);
+		if (n.z < 0.0f)
+		{
+			e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		packed.Normal[0] = static_cast<GLshort>(glm::round(glm::clamp(e.x, -1.0f, 1.0f) * 32767.0f));
+		packed.Normal[1] = static_cast<GLshort>(glm::round(glm::clamp(e.y, -1.0f, 1.0f) * 32767.0f));
+
+		packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+
+		return packed;
 	}
 };
\ No newline at end of file
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "Mesh.h"
+#include "AssetPack.h"
+
+using namespace std;
+
+// Bump whenever the layout of the cache file or the data produced by the import pipeline changes
+const uint32_t MESH_CACHE_VERSION = 6;
+
+// A texture as referenced by a material, resolved into a GL texture only when the Mesh is created
+struct TextureRef
+{
+	string type;
+	string path;
+};
+
+// CPU-side result of importing a mesh: exactly what Mesh needs to be built
+struct MeshData
+{
+	vector<Vertex> vertices;
+	vector<GLuint> indices;			// Every level of detail, one after the other
+	vector<GLuint> lodOffsets;		// First index of every level, LOD0 first
+	vector<Meshlet> meshlets;		// Clusters of LOD0
+	vector<TextureRef> textures;
+};
+
+// Figures about the import kept in the cache, so a warm start can still report them
+struct ImportStats
+{
+	float coldLoadMs;	// Time the import took
+	uint32_t verticesImported;	// Vertices ASSIMP produced...
+	uint32_t verticesWelded;	// ...and left after welding
+	float acmrBefore;	// Vertex cache efficiency of the source index order...
+	float atvrBefore;
+	float acmrAfter;	// ...and of the optimized one (see MeshOptimizer.h)
+	float atvrAfter;
+};
+
+// On-disk binary cache of the meshes of a model, keyed by source path + modification time + import flags
+// + a hash of any other import settings + the stamps of the files the import read besides the source (MTL libraries).
+// A hit is memory-mapped and read in place, no text parsing involved.
+class MeshCache
+{
+public:
+	// A mesh inside the mapped cache file. Pointers stay valid while the cache is open.
+	struct MeshView
+	{
+		const Vertex *vertices;
+		GLuint vertexCount;
+		const GLuint *indices;
+		GLuint indexCount;
+		const GLuint *lodOffsets;
+		GLuint lodCount;
+		const Meshlet *meshlets;
+		GLuint meshletCount;
+		vector<TextureRef> textures;
+	};
+
+	// Returns the path of the cache file that belongs to the given source file
+	static string CachePath(const string &sourcePath)
+	{
+		return sourcePath + ".meshcache";
+	}
+
+	// Maps the cache of the given source. Returns false on a miss (no cache, stale source, other flags, settings or version).
+	bool Open(const string &sourcePath, GLuint importFlags, uint64_t settingsHash)
+	{
+		this->Close();
+
+		FileStamp stamp;
+		if (!GetAssetStamp(sourcePath, stamp) || !this->file.Open(CachePath(sourcePath)))
+		{
+			return false;
+		}
+
+		const unsigned char *data = this->file.Data();
+		size_t size = this->file.Size();
+		if (size < sizeof(Header))
+		{
+			this->file.Close();
+			return false;
+		}
+
+		const Header *h = reinterpret_cast<const Header *>(data);
+		if (memcmp(h->magic, "MSHC", 4) != 0 || h->version != MESH_CACHE_VERSION || h->vertexSize != sizeof(Vertex) ||
+			h->importFlags != importFlags || h->settingsHash != settingsHash || h->sourceSize != stamp.size || h->sourceMTime != stamp.mtime)
+		{
+			this->file.Close();
+			return false;
+		}
+
+		// The source path is part of the key too, a copied cache must not be picked up for another file
+		size_t dependenciesOffset = align(sizeof(Header) + h->pathLength);
+		if (dependenciesOffset > size || string(reinterpret_cast<const char *>(data + sizeof(Header)), h->pathLength) != sourcePath)
+		{
+			this->file.Close();
+			return false;
+		}
+
+		// So are the files the import read along with it, an edited material must not keep the old textures
+		size_t entriesOffset = dependenciesOffset;
+		for (uint32_t i = 0; i < h->dependencyCount; i++)
+		{
+			Dependency dependency;
+			if (entriesOffset + sizeof(Dependency) > size)
+			{
+				this->file.Close();
+				return false;
+			}
+			memcpy(&dependency, data + entriesOffset, sizeof(Dependency));
+			entriesOffset += sizeof(Dependency);
+			if (entriesOffset + dependency.pathLength > size)
+			{
+				this->file.Close();
+				return false;
+			}
+
+			FileStamp current;
+			if (!GetAssetStamp(string(reinterpret_cast<const char *>(data + entriesOffset), dependency.pathLength), current))
+			{
+				current.size = current.mtime = -1;
+			}
+			if (current.size != dependency.size || current.mtime != dependency.mtime)
+			{
+				this->file.Close();
+				return false;
+			}
+			entriesOffset = align(entriesOffset + dependency.pathLength);
+		}
+		if (entriesOffset + h->meshCount * sizeof(Entry) > size)
+		{
+			this->file.Close();
+			return false;
+		}
+
+		const Entry *e = reinterpret_cast<const Entry *>(data + entriesOffset);
+		for (GLuint i = 0; i < h->meshCount; i++)
+		{
+			if (e[i].vertexOffset + uint64_t(e[i].vertexCount) * sizeof(Vertex) > size ||
+				e[i].indexOffset + uint64_t(e[i].indexCount) * sizeof(GLuint) > size ||
+				e[i].textureOffset > size || e[i].lodCount == 0 || e[i].lodCount > MESH_LOD_MAX ||
+				e[i].meshletOffset + uint64_t(e[i].meshletCount) * sizeof(Meshlet) > size)
+			{
+				this->file.Close();
+				return false;
+			}
+			const Meshlet *meshlets = reinterpret_cast<const Meshlet *>(data + e[i].meshletOffset);
+			for (GLuint m = 0; m < e[i].meshletCount; m++)
+			{
+				if (uint64_t(meshlets[m].firstIndex) + meshlets[m].indexCount > e[i].indexCount)
+				{
+					this->file.Close();
+					return false;
+				}
+			}
+			for (GLuint l = 1; l < e[i].lodCount; l++)
+			{
+				if (e[i].lodOffsets[l] < e[i].lodOffsets[l - 1] || e[i].lodOffsets[l] > e[i].indexCount)
+				{
+					this->file.Close();
+					return false;
+				}
+			}
+		}
+
+		this->header = h;
+		this->entries = e;
+		return true;
+	}
+
+	void Close()
+	{
+		this->file.Close();
+		this->header = nullptr;
+		this->entries = nullptr;
+	}
+
+	GLuint MeshCount() const
+	{
+		return this->header ? this->header->meshCount : 0;
+	}
+
+	// Figures of the import that wrote this cache
+	ImportStats Stats() const
+	{
+		ImportStats stats;
+		memset(&stats, 0, sizeof(stats));
+		if (this->header)
+		{
+			stats = this->header->stats;
+		}
+		return stats;
+	}
+
+	MeshView GetMesh(GLuint i) const
+	{
+		const unsigned char *data = this->file.Data();
+		const Entry &e = this->entries[i];
+
+		MeshView view;
+		view.vertices = reinterpret_cast<const Vertex *>(data + e.vertexOffset);
+		view.vertexCount = e.vertexCount;
+		view.indices = reinterpret_cast<const GLuint *>(data + e.indexOffset);
+		view.indexCount = e.indexCount;
+		view.lodOffsets = e.lodOffsets;
+		view.lodCount = e.lodCount;
+		view.meshlets = reinterpret_cast<const Meshlet *>(data + e.meshletOffset);
+		view.meshletCount = e.meshletCount;
+
+		// Texture records: type length, path length, then both strings
+		const unsigned char *cursor = data + e.textureOffset;
+		const unsigned char *end = data + this->file.Size();
+		for (GLuint t = 0; t < e.textureCount; t++)
+		{
+			uint32_t lengths[2];
+			if (cursor + sizeof(lengths) > end)
+			{
+				break;
+			}
+			memcpy(lengths, cursor, sizeof(lengths));
+			cursor += sizeof(lengths);
+			if (cursor + lengths[0] + lengths[1] > end)
+			{
+				break;
+			}
+
+			TextureRef ref;
+			ref.type.assign(reinterpret_cast<const char *>(cursor), lengths[0]);
+			ref.path.assign(reinterpret_cast<const char *>(cursor + lengths[0]), lengths[1]);
+			cursor += lengths[0] + lengths[1];
+			view.textures.push_back(ref);
+		}
+
+		return view;
+	}
+
+	// Writes the cache for the given source. dependencies are the other files the import read, a missing one
+	// is keyed as such.
+	static bool Write(const string &sourcePath, GLuint importFlags, uint64_t settingsHash, const vector<string> &dependencies,
+		const vector<MeshData> &meshes, const ImportStats &stats)
+	{
+		FileStamp stamp;
+		if (!GetAssetStamp(sourcePath, stamp))
+		{
+			return false;
+		}
+
+		Header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, "MSHC", 4);
+		h.version = MESH_CACHE_VERSION;
+		h.vertexSize = sizeof(Vertex);
+		h.importFlags = importFlags;
+		h.settingsHash = settingsHash;
+		h.meshCount = static_cast<uint32_t>(meshes.size());
+		h.pathLength = static_cast<uint32_t>(sourcePath.size());
+		h.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		h.sourceSize = stamp.size;
+		h.sourceMTime = stamp.mtime;
+		h.stats = stats;
+
+		vector<unsigned char> blob;
+		append(blob, &h, sizeof(h));
+		append(blob, sourcePath.data(), sourcePath.size());
+		blob.resize(align(blob.size()));
+
+		// Dependency records: stamp and path length, then the path
+		for (size_t i = 0; i < dependencies.size(); i++)
+		{
+			FileStamp dependencyStamp;
+			if (!GetAssetStamp(dependencies[i], dependencyStamp))
+			{
+				dependencyStamp.size = dependencyStamp.mtime = -1;
+			}
+			Dependency dependency;
+			memset(&dependency, 0, sizeof(dependency));
+			dependency.size = dependencyStamp.size;
+			dependency.mtime = dependencyStamp.mtime;
+			dependency.pathLength = static_cast<uint32_t>(dependencies[i].size());
+			append(blob, &dependency, sizeof(dependency));
+			append(blob, dependencies[i].data(), dependencies[i].size());
+			blob.resize(align(blob.size()));
+		}
+
+		size_t entriesOffset = blob.size();
+		blob.resize(entriesOffset + meshes.size() * sizeof(Entry));
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const MeshData &mesh = meshes[i];
+			Entry e;
+			memset(&e, 0, sizeof(e));
+
+			e.vertexOffset = blob.size();
+			e.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+			append(blob, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+
+			e.indexOffset = blob.size();
+			e.indexCount = static_cast<uint32_t>(mesh.indices.size());
+			append(blob, mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+
+			e.lodCount = max<uint32_t>(1, static_cast<uint32_t>(min<size_t>(mesh.lodOffsets.size(), MESH_LOD_MAX)));
+			for (uint32_t l = 1; l < e.lodCount; l++)
+			{
+				e.lodOffsets[l] = mesh.lodOffsets[l];
+			}
+
+			e.meshletOffset = blob.size();
+			e.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+			append(blob, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+
+			e.textureOffset = blob.size();
+			e.textureCount = static_cast<uint32_t>(mesh.textures.size());
+			for (size_t t = 0; t < mesh.textures.size(); t++)
+			{
+				uint32_t lengths[2] = { static_cast<uint32_t>(mesh.textures[t].type.size()), static_cast<uint32_t>(mesh.textures[t].path.size()) };
+				append(blob, lengths, sizeof(lengths));
+				append(blob, mesh.textures[t].type.data(), lengths[0]);
+				append(blob, mesh.textures[t].path.data(), lengths[1]);
+			}
+			blob.resize(align(blob.size()));
+
+			memcpy(&blob[entriesOffset + i * sizeof(Entry)], &e, sizeof(e));
+		}
+
+		if (!WriteFileAtomic(CachePath(sourcePath), blob.data(), blob.size()))
+		{
+			cout << "ERROR::MESH_CACHE::WRITE_FAILED " << CachePath(sourcePath) << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t importFlags;
+		uint32_t meshCount;
+		uint32_t pathLength;
+		int64_t sourceSize;
+		int64_t sourceMTime;
+		uint64_t settingsHash;
+		ImportStats stats;
+		uint32_t dependencyCount;
+		uint32_t reserved;
+	};
+
+	struct Dependency
+	{
+		int64_t size;
+		int64_t mtime;
+		uint32_t pathLength;
+		uint32_t reserved;
+	};
+
+	struct Entry
+	{
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint64_t textureOffset;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t textureCount;
+		uint32_t lodCount;
+		uint32_t lodOffsets[MESH_LOD_MAX];
+		uint64_t meshletOffset;
+		uint32_t meshletCount;
+		uint32_t reserved;
+	};
+
+	AssetFile file;
+	const Header *header = nullptr;
+	const Entry *entries = nullptr;
+
+	// Every section starts 8-byte aligned so the mapped arrays can be read in place
+	static size_t align(size_t offset)
+	{
+		return (offset + 7) & ~size_t(7);
+	}
+
+	static void append(vector<unsigned char> &blob, const void *data, size_t bytes)
+	{
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		blob.insert(blob.end(), p, p + bytes);
+	}
+};
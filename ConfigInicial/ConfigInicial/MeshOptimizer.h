@@ -0,0 +1,516 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include "Mesh.h"
+#include "Meshlet.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Entries of the LRU cache the triangle order is optimized for
+const GLuint VERTEX_CACHE_SIZE = 32;
+// Entries of the FIFO cache the order is measured with, about what current GPUs reuse
+const GLuint VERTEX_CACHE_ANALYSIS_SIZE = 16;
+
+// Tuning of Forsyth's vertex score
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+// Vertices per chunk and number of hash shards of the parallel welding pass
+const size_t WELD_GRAIN = 16384;
+const size_t WELD_SHARDS = 64;
+
+// How far apart two vertices may be, per attribute, and still be welded into one. 0 welds exact copies only.
+struct WeldTolerance
+{
+	float position;
+	float normal;
+	float texCoord;
+};
+
+// Result of running an index buffer through a simulated post-transform cache
+struct VertexCacheStats
+{
+	size_t triangles;
+	size_t vertices;
+	size_t misses;
+
+	// Average cache miss ratio: transformed vertices per triangle, 0.5 at best and 3 at worst
+	float ACMR() const
+	{
+		return this->triangles ? float(this->misses) / this->triangles : 0.0f;
+	}
+
+	// Average transform to vertex ratio: times each vertex is transformed, 1 at best
+	float ATVR() const
+	{
+		return this->vertices ? float(this->misses) / this->vertices : 0.0f;
+	}
+};
+
+// Counts the vertex shader invocations a FIFO post-transform cache of cacheSize entries would need for the indices
+VertexCacheStats AnalyzeVertexCache(const GLuint *indices, size_t indexCount, size_t vertexCount, GLuint cacheSize = VERTEX_CACHE_ANALYSIS_SIZE)
+{
+	VertexCacheStats stats;
+	stats.triangles = indexCount / 3;
+	stats.vertices = vertexCount;
+	stats.misses = 0;
+
+	// A vertex is in the cache if fewer than cacheSize misses happened since it was last loaded
+	vector<size_t> loadedAt(vertexCount, 0);
+	size_t time = cacheSize + 1;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		GLuint v = indices[i];
+		if (time - loadedAt[v] > cacheSize)
+		{
+			loadedAt[v] = time++;
+			stats.misses++;
+		}
+	}
+
+	return stats;
+}
+
+// Score of a vertex by its LRU cache position (-1 if not cached) and the number of triangles still using it
+float forsythVertexScore(int cachePosition, GLuint remainingTriangles)
+{
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			// Used by the triangle just emitted, deliberately lower so strips don't go back and forth
+			score = FORSYTH_LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+			score = pow(1.0f - (cachePosition - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+
+	// Favour vertices with few triangles left, so lone triangles are not left behind
+	score += FORSYTH_VALENCE_BOOST_SCALE * pow(float(remainingTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+	return score;
+}
+
+// Reorders the triangles for post-transform cache reuse (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation").
+// Greedily emits the best scoring triangle among those touching the simulated cache. Works in place on a range of indices.
+void OptimizeVertexCache(GLuint *indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles using each vertex, as ranges of one flat array. remaining[v] is the length of the live part of the range.
+	vector<GLuint> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		remaining[indices[i]]++;
+	}
+	vector<size_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	vector<GLuint> adjacency(triangleCount * 3);
+	vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[fill[indices[i]]++] = static_cast<GLuint>(i / 3);
+	}
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+	}
+
+	vector<float> triangleScore(triangleCount);
+	vector<bool> emitted(triangleCount, false);
+	size_t best = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+		if (triangleScore[t] > triangleScore[best])
+		{
+			best = t;
+		}
+	}
+
+	vector<GLuint> result;
+	result.reserve(triangleCount * 3);
+	vector<GLuint> cache;
+	vector<GLuint> nextCache;
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+	size_t scan = 0;
+
+	while (result.size() < triangleCount * 3)
+	{
+		const GLuint *corners = &indices[best * 3];
+		emitted[best] = true;
+		result.insert(result.end(), corners, corners + 3);
+
+		// The emitted triangle no longer counts towards the valence of its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = corners[k];
+			GLuint *live = &adjacency[offsets[v]];
+			for (GLuint j = 0; j < remaining[v]; j++)
+			{
+				if (live[j] == best)
+				{
+					live[j] = live[remaining[v] - 1];
+					remaining[v]--;
+					break;
+				}
+			}
+		}
+
+		// LRU update: the triangle's vertices move to the front, the rest shifts back
+		nextCache.clear();
+		for (int k = 0; k < 3; k++)
+		{
+			if (find(nextCache.begin(), nextCache.end(), corners[k]) == nextCache.end())
+			{
+				nextCache.push_back(corners[k]);
+			}
+		}
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			if (find(nextCache.begin(), nextCache.end(), cache[i]) == nextCache.end())
+			{
+				nextCache.push_back(cache[i]);
+			}
+		}
+
+		// Rescore every vertex whose position changed and propagate the difference to its live triangles
+		for (size_t i = 0; i < nextCache.size(); i++)
+		{
+			GLuint v = nextCache[i];
+			cachePosition[v] = i < VERTEX_CACHE_SIZE ? static_cast<int>(i) : -1;
+
+			float score = forsythVertexScore(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (GLuint j = 0; j < remaining[v]; j++)
+			{
+				triangleScore[adjacency[offsets[v] + j]] += delta;
+			}
+		}
+		if (nextCache.size() > VERTEX_CACHE_SIZE)
+		{
+			nextCache.resize(VERTEX_CACHE_SIZE);
+		}
+		cache.swap(nextCache);
+
+		// Next triangle: the best one touching the cache, or else the first one not emitted yet
+		bool found = false;
+		float bestScore = 0.0f;
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			GLuint v = cache[i];
+			for (GLuint j = 0; j < remaining[v]; j++)
+			{
+				GLuint t = adjacency[offsets[v] + j];
+				if (!found || triangleScore[t] > bestScore)
+				{
+					best = t;
+					bestScore = triangleScore[t];
+					found = true;
+				}
+			}
+		}
+		if (!found)
+		{
+			while (scan < triangleCount && emitted[scan])
+			{
+				scan++;
+			}
+			best = scan;
+		}
+	}
+
+	copy(result.begin(), result.end(), indices);
+}
+
+// Renumbers the vertices in order of first use, so the vertex fetch walks memory mostly forward.
+// Vertices no triangle references are dropped.
+void OptimizeVertexFetch(vector<Vertex> &vertices, vector<GLuint> &indices)
+{
+	const GLuint unassigned = ~GLuint(0);
+	vector<GLuint> remap(vertices.size(), unassigned);
+
+	vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		GLuint &index = indices[i];
+		if (remap[index] == unassigned)
+		{
+			remap[index] = static_cast<GLuint>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+}
+
+// A vertex snapped to the tolerance grid. Vertices with equal keys are welded.
+struct WeldKey
+{
+	int32_t cells[8];
+
+	bool operator==(const WeldKey &other) const
+	{
+		return memcmp(this->cells, other.cells, sizeof(this->cells)) == 0;
+	}
+};
+
+struct WeldKeyHash
+{
+	size_t operator()(const WeldKey &key) const
+	{
+		return static_cast<size_t>(Hash64(key.cells, sizeof(key.cells)));
+	}
+};
+
+// Grid cell of a value, or its bit pattern when welding exact copies only
+int32_t weldCell(float value, float tolerance)
+{
+	if (tolerance <= 0.0f)
+	{
+		value += 0.0f;	// -0 and +0 are the same value
+		int32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	double cell = floor(double(value) / tolerance + 0.5);
+	return static_cast<int32_t>(max(-2147483647.0, min(2147483647.0, cell)));
+}
+
+WeldKey weldKey(const Vertex &vertex, const WeldTolerance &tolerance)
+{
+	WeldKey key;
+	for (int k = 0; k < 3; k++)
+	{
+		key.cells[k] = weldCell(vertex.Position[k], tolerance.position);
+		key.cells[3 + k] = weldCell(vertex.Normal[k], tolerance.normal);
+	}
+	key.cells[6] = weldCell(vertex.TexCoords.x, tolerance.texCoord);
+	key.cells[7] = weldCell(vertex.TexCoords.y, tolerance.texCoord);
+	return key;
+}
+
+// Collapses vertices that match within the tolerance into the first of them and rewrites the indices.
+// Keys are built and deduplicated in parallel (one hash map per shard of the key space) on the shared pool.
+// Vertices are snapped to a grid of the tolerance, so two close values on either side of a cell boundary stay apart.
+void WeldVertices(vector<Vertex> &vertices, vector<GLuint> &indices, const WeldTolerance &tolerance)
+{
+	size_t vertexCount = vertices.size();
+	if (vertexCount == 0)
+	{
+		return;
+	}
+
+	ThreadPool &pool = ThreadPool::Shared();
+
+	vector<WeldKey> keys(vertexCount);
+	vector<uint32_t> shards(vertexCount);
+	pool.ParallelFor(vertexCount, WELD_GRAIN, [&](size_t begin, size_t end)
+	{
+		WeldKeyHash hash;
+		for (size_t i = begin; i < end; i++)
+		{
+			keys[i] = weldKey(vertices[i], tolerance);
+			shards[i] = static_cast<uint32_t>((hash(keys[i]) >> 32) % WELD_SHARDS);
+		}
+	});
+
+	// Bucket the vertices by shard, keeping each bucket in vertex order
+	vector<size_t> shardStart(WELD_SHARDS + 1, 0);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		shardStart[shards[i] + 1]++;
+	}
+	for (size_t s = 0; s < WELD_SHARDS; s++)
+	{
+		shardStart[s + 1] += shardStart[s];
+	}
+	vector<GLuint> bucketed(vertexCount);
+	vector<size_t> fill(shardStart.begin(), shardStart.end() - 1);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		bucketed[fill[shards[i]]++] = static_cast<GLuint>(i);
+	}
+
+	// The first vertex with a given key represents all of them
+	vector<GLuint> representative(vertexCount);
+	pool.ParallelFor(WELD_SHARDS, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t s = begin; s < end; s++)
+		{
+			unordered_map<WeldKey, GLuint, WeldKeyHash> firstOf;
+			firstOf.reserve(shardStart[s + 1] - shardStart[s]);
+			for (size_t j = shardStart[s]; j < shardStart[s + 1]; j++)
+			{
+				GLuint i = bucketed[j];
+				representative[i] = firstOf.insert(make_pair(keys[i], i)).first->second;
+			}
+		}
+	});
+
+	// Representatives precede the vertices they absorb, so one forward pass compacts the array
+	vector<GLuint> remap(vertexCount);
+	vector<Vertex> welded;
+	welded.reserve(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		if (representative[i] == i)
+		{
+			remap[i] = static_cast<GLuint>(welded.size());
+			welded.push_back(vertices[i]);
+		}
+		else
+		{
+			remap[i] = remap[representative[i]];
+		}
+	}
+
+	pool.ParallelFor(indices.size(), WELD_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			indices[i] = remap[indices[i]];
+		}
+	});
+
+	vertices.swap(welded);
+}
+
+// Bounding sphere and normal cone of the triangles of a meshlet
+void meshletBounds(const vector<Vertex> &vertices, const GLuint *indices, Meshlet &meshlet)
+{
+	const GLuint *first = indices + meshlet.firstIndex;
+
+	glm::vec3 boundsMin = vertices[first[0]].Position, boundsMax = boundsMin;
+	for (GLuint i = 1; i < meshlet.indexCount; i++)
+	{
+		boundsMin = glm::min(boundsMin, vertices[first[i]].Position);
+		boundsMax = glm::max(boundsMax, vertices[first[i]].Position);
+	}
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = 0.0f;
+	for (GLuint i = 0; i < meshlet.indexCount; i++)
+	{
+		radius = max(radius, glm::length(vertices[first[i]].Position - center));
+	}
+
+	vector<glm::vec3> normals;
+	glm::vec3 axis(0.0f);
+	for (GLuint i = 0; i + 2 < meshlet.indexCount; i += 3)
+	{
+		glm::vec3 p0 = vertices[first[i]].Position, p1 = vertices[first[i + 1]].Position, p2 = vertices[first[i + 2]].Position;
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(n);
+		if (length > 0.0f)
+		{
+			normals.push_back(n / length);
+			axis += n / length;
+		}
+	}
+
+	// The widest angle between the axis and any normal decides whether the cone can ever face away as a whole
+	float axisLength = glm::length(axis);
+	float minDot = 1.0f;
+	if (axisLength > 0.0f)
+	{
+		axis /= axisLength;
+		for (size_t i = 0; i < normals.size(); i++)
+		{
+			minDot = min(minDot, glm::dot(axis, normals[i]));
+		}
+	}
+
+	for (int k = 0; k < 3; k++)
+	{
+		meshlet.center[k] = center[k];
+		meshlet.coneAxis[k] = axis[k];
+	}
+	meshlet.radius = radius;
+	meshlet.coneCutoff = (axisLength > 0.0f && minDot > 0.1f) ? sqrt(1.0f - minDot * minDot) : 1.0f;
+}
+
+// Splits a range of triangles into meshlets in their current order, which after OptimizeVertexCache is already
+// spatially coherent. A meshlet closes once it reaches MESHLET_MAX_TRIANGLES or MESHLET_MAX_VERTICES.
+void BuildMeshlets(const vector<Vertex> &vertices, const vector<GLuint> &indices, GLuint firstIndex, GLuint indexCount, vector<Meshlet> &meshlets)
+{
+	meshlets.clear();
+
+	// Meshlet that last used each vertex, to count distinct vertices without clearing a set
+	vector<GLuint> usedBy(vertices.size(), ~GLuint(0));
+	Meshlet current;
+	current.firstIndex = firstIndex;
+	current.indexCount = 0;
+	GLuint vertexCount = 0;
+
+	for (GLuint i = firstIndex; i + 2 < firstIndex + indexCount; i += 3)
+	{
+		GLuint id = static_cast<GLuint>(meshlets.size());
+		GLuint added = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			added += usedBy[indices[i + k]] != id ? 1 : 0;
+		}
+
+		if (current.indexCount > 0 && (current.indexCount / 3 >= MESHLET_MAX_TRIANGLES || vertexCount + added > MESHLET_MAX_VERTICES))
+		{
+			meshletBounds(vertices, indices.data(), current);
+			meshlets.push_back(current);
+			current.firstIndex = i;
+			current.indexCount = 0;
+			vertexCount = 0;
+			id++;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (usedBy[indices[i + k]] != id)
+			{
+				usedBy[indices[i + k]] = id;
+				vertexCount++;
+			}
+		}
+		current.indexCount += 3;
+	}
+
+	if (current.indexCount > 0)
+	{
+		meshletBounds(vertices, indices.data(), current);
+		meshlets.push_back(current);
+	}
+}
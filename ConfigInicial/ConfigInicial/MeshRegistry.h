@@ -0,0 +1,133 @@
+#pragma once
+
+#include <sstream>
+#include <iostream>
+#include <unordered_map>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+using namespace std;
+
+// Vertex array and buffers holding one mesh's geometry on the GPU
+struct MeshBuffers
+{
+	GLuint VAO;
+	GLuint VBO;
+	GLuint EBO;
+};
+
+// Process-wide, reference-counted set of mesh buffers shared by every Model. Meshes are found by the hash of
+// the exact vertex and index data they upload, so copies of the same geometry in other models, like the two
+// fans, draw from one set of buffers. Only used on the GL context thread.
+class MeshRegistry
+{
+public:
+	static MeshRegistry &Instance()
+	{
+		static MeshRegistry registry;
+		return registry;
+	}
+
+	// Finds the buffers already holding this geometry and adds a reference to them. Returns false if there are none.
+	bool Acquire(uint64_t contentHash, size_t vertexBytes, size_t indexBytes, MeshBuffers &buffers)
+	{
+		unordered_map<uint64_t, GLuint>::const_iterator byContent = this->contents.find(contentHash);
+		if (byContent == this->contents.end())
+		{
+			return false;
+		}
+
+		// Same hash but different sizes is a collision, the mesh gets its own buffers
+		Entry &entry = this->entries[byContent->second];
+		if (entry.vertexBytes != vertexBytes || entry.indexBytes != indexBytes)
+		{
+			return false;
+		}
+
+		entry.refs++;
+		entry.shares++;
+		buffers = entry.buffers;
+		return true;
+	}
+
+	// Registers the buffers a mesh just created, with one reference
+	void Add(uint64_t contentHash, size_t vertexBytes, size_t indexBytes, const MeshBuffers &buffers)
+	{
+		Entry entry;
+		entry.buffers = buffers;
+		entry.refs = 1;
+		entry.shares = 0;
+		entry.contentHash = contentHash;
+		entry.vertexBytes = vertexBytes;
+		entry.indexBytes = indexBytes;
+		this->entries[buffers.VAO] = entry;
+		if (this->contents.find(contentHash) == this->contents.end())
+		{
+			this->contents[contentHash] = buffers.VAO;
+		}
+	}
+
+	// Drops a reference to the buffers of a vertex array, the last one deletes them
+	void Release(GLuint VAO)
+	{
+		unordered_map<GLuint, Entry>::iterator it = this->entries.find(VAO);
+		if (it == this->entries.end() || --it->second.refs > 0)
+		{
+			return;
+		}
+
+		unordered_map<uint64_t, GLuint>::iterator byContent = this->contents.find(it->second.contentHash);
+		if (byContent != this->contents.end() && byContent->second == VAO)
+		{
+			this->contents.erase(byContent);
+		}
+
+		MeshBuffers &buffers = it->second.buffers;
+		glDeleteVertexArrays(1, &buffers.VAO);
+		glDeleteBuffers(1, &buffers.VBO);
+		glDeleteBuffers(1, &buffers.EBO);
+		this->entries.erase(it);
+	}
+
+	// Prints the duplicate meshes found and the buffer memory sharing them saved
+	void Report() const
+	{
+		size_t shared = 0;
+		size_t bytesUsed = 0;
+		size_t bytesSaved = 0;
+		for (unordered_map<GLuint, Entry>::const_iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+		{
+			size_t bytes = it->second.vertexBytes + it->second.indexBytes;
+			shared += it->second.shares;
+			bytesUsed += bytes;
+			bytesSaved += bytes * it->second.shares;
+		}
+
+		ostringstream log;
+		log << "MESH::REGISTRY:: " << this->entries.size() << " meshes on the GPU, " << shared << " duplicates shared; "
+			<< bytesUsed / 1024 << " KB of buffers, " << bytesSaved / 1024 << " KB saved" << endl;
+		cout << log.str();
+	}
+
+private:
+	struct Entry
+	{
+		MeshBuffers buffers;
+		GLuint refs;
+		GLuint shares;			// Acquires served by these buffers that would have created new ones
+		uint64_t contentHash;
+		size_t vertexBytes;
+		size_t indexBytes;
+	};
+
+	unordered_map<GLuint, Entry> entries;		// By vertex array
+	unordered_map<uint64_t, GLuint> contents;
+
+	MeshRegistry()
+	{
+	}
+
+	MeshRegistry(const MeshRegistry &);
+	MeshRegistry &operator=(const MeshRegistry &);
+};
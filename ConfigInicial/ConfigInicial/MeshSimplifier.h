@@ -0,0 +1,282 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+using namespace std;
+
+// Fraction of the LOD0 triangles each further level aims for
+const float LOD_TRIANGLE_RATIOS[MESH_LOD_MAX - 1] = { 0.5f, 0.25f, 0.1f };
+// A level has to drop at least this share of the previous level's triangles to be kept
+const float LOD_MIN_REDUCTION = 0.15f;
+// Finest clustering grid, in cells along the longest side of the mesh
+const GLuint LOD_GRID_MAX = 1024;
+
+// Garland and Heckbert's error quadric: the weighted sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric
+{
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+
+	void Clear()
+	{
+		this->a00 = this->a01 = this->a02 = this->a03 = 0.0;
+		this->a11 = this->a12 = this->a13 = 0.0;
+		this->a22 = this->a23 = 0.0;
+		this->a33 = 0.0;
+	}
+
+	// Adds the plane n.p + d = 0, n being unit length
+	void AddPlane(const glm::dvec3 &n, double d, double weight)
+	{
+		this->a00 += weight * n.x * n.x;
+		this->a01 += weight * n.x * n.y;
+		this->a02 += weight * n.x * n.z;
+		this->a03 += weight * n.x * d;
+		this->a11 += weight * n.y * n.y;
+		this->a12 += weight * n.y * n.z;
+		this->a13 += weight * n.y * d;
+		this->a22 += weight * n.z * n.z;
+		this->a23 += weight * n.z * d;
+		this->a33 += weight * d * d;
+	}
+
+	void Add(const Quadric &q)
+	{
+		this->a00 += q.a00;
+		this->a01 += q.a01;
+		this->a02 += q.a02;
+		this->a03 += q.a03;
+		this->a11 += q.a11;
+		this->a12 += q.a12;
+		this->a13 += q.a13;
+		this->a22 += q.a22;
+		this->a23 += q.a23;
+		this->a33 += q.a33;
+	}
+
+	// Error of moving every plane's geometry to p
+	double Error(const glm::vec3 &p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return this->a00 * x * x + 2.0 * this->a01 * x * y + 2.0 * this->a02 * x * z + 2.0 * this->a03 * x
+			+ this->a11 * y * y + 2.0 * this->a12 * y * z + 2.0 * this->a13 * y
+			+ this->a22 * z * z + 2.0 * this->a23 * z
+			+ this->a33;
+	}
+};
+
+// Assigns every vertex to a cell of a grid with gridSize cells along the longest side of the bounds
+void lodCells(const vector<Vertex> &vertices, const glm::vec3 &boundsMin, float extent, GLuint gridSize, vector<uint64_t> &cells)
+{
+	float scale = gridSize / extent;
+	cells.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		glm::vec3 p = (vertices[i].Position - boundsMin) * scale;
+		uint64_t x = min<uint64_t>(gridSize - 1, static_cast<uint64_t>(max(0.0f, p.x)));
+		uint64_t y = min<uint64_t>(gridSize - 1, static_cast<uint64_t>(max(0.0f, p.y)));
+		uint64_t z = min<uint64_t>(gridSize - 1, static_cast<uint64_t>(max(0.0f, p.z)));
+		cells[i] = x + (y + z * gridSize) * gridSize;
+	}
+}
+
+// Triangles that survive a clustering: those with their three corners in different cells
+size_t lodSurvivingTriangles(const vector<GLuint> &indices, size_t indexCount, const vector<uint64_t> &cells)
+{
+	size_t count = 0;
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		uint64_t a = cells[indices[i]], b = cells[indices[i + 1]], c = cells[indices[i + 2]];
+		if (a != b && b != c && a != c)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+// Quadric-error vertex clustering (Lindstrom, "Out-of-Core Simplification of Large Polygonal Models"). Each cell collapses
+// onto the vertex of the cell with the least error against the summed quadrics of the cell, and every other vertex of the
+// cell is redirected to the copy of that position whose normal matches its own best, so flat shading survives.
+// Only indices are produced: every vertex a level uses is an existing one, so all levels share the vertex buffer.
+void lodCluster(const vector<Vertex> &vertices, const vector<GLuint> &indices, size_t indexCount, const vector<Quadric> &quadrics,
+	const vector<uint64_t> &cells, vector<GLuint> &result)
+{
+	// Group the vertices by cell
+	vector<GLuint> order(vertices.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = static_cast<GLuint>(i);
+	}
+	sort(order.begin(), order.end(), [&cells](GLuint a, GLuint b) { return cells[a] < cells[b]; });
+
+	vector<GLuint> remap(vertices.size());
+	vector<GLuint> copies;
+	size_t begin = 0;
+	while (begin < order.size())
+	{
+		size_t end = begin + 1;
+		while (end < order.size() && cells[order[end]] == cells[order[begin]])
+		{
+			end++;
+		}
+
+		Quadric q;
+		q.Clear();
+		for (size_t j = begin; j < end; j++)
+		{
+			q.Add(quadrics[order[j]]);
+		}
+
+		GLuint best = order[begin];
+		double bestError = q.Error(vertices[best].Position);
+		for (size_t j = begin + 1; j < end; j++)
+		{
+			double error = q.Error(vertices[order[j]].Position);
+			if (error < bestError)
+			{
+				best = order[j];
+				bestError = error;
+			}
+		}
+
+		// Every vertex sitting exactly on the chosen position
+		copies.clear();
+		for (size_t j = begin; j < end; j++)
+		{
+			if (vertices[order[j]].Position == vertices[best].Position)
+			{
+				copies.push_back(order[j]);
+			}
+		}
+
+		for (size_t j = begin; j < end; j++)
+		{
+			GLuint v = order[j];
+			GLuint target = best;
+			float bestDot = -2.0f;
+			for (size_t k = 0; k < copies.size(); k++)
+			{
+				GLuint candidate = copies[k];
+				float d = glm::dot(vertices[candidate].Normal, vertices[v].Normal);
+				if (d > bestDot)
+				{
+					target = candidate;
+					bestDot = d;
+				}
+			}
+			remap[v] = target;
+		}
+
+		begin = end;
+	}
+
+	result.clear();
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		GLuint a = indices[i], b = indices[i + 1], c = indices[i + 2];
+		if (cells[a] != cells[b] && cells[b] != cells[c] && cells[a] != cells[c])
+		{
+			result.push_back(remap[a]);
+			result.push_back(remap[b]);
+			result.push_back(remap[c]);
+		}
+	}
+}
+
+// Appends up to MESH_LOD_MAX - 1 coarser versions of the triangles in indices (LOD0) to the same array and sets
+// lodOffsets to the first index of every level, LOD0 included. Levels that would barely reduce are skipped.
+void GenerateLods(const vector<Vertex> &vertices, vector<GLuint> &indices, vector<GLuint> &lodOffsets)
+{
+	lodOffsets.assign(1, 0);
+
+	size_t indexCount = indices.size();
+	size_t triangleCount = indexCount / 3;
+	if (vertices.empty() || triangleCount == 0 || indexCount % 3 != 0)
+	{
+		return;
+	}
+
+	glm::vec3 boundsMin = vertices[0].Position, boundsMax = vertices[0].Position;
+	for (size_t i = 1; i < vertices.size(); i++)
+	{
+		boundsMin = glm::min(boundsMin, vertices[i].Position);
+		boundsMax = glm::max(boundsMax, vertices[i].Position);
+	}
+	glm::vec3 size = boundsMax - boundsMin;
+	float extent = max(size.x, max(size.y, size.z));
+	if (extent <= 0.0f)
+	{
+		return;
+	}
+
+	// Area-weighted quadric of the planes around every vertex
+	vector<Quadric> quadrics(vertices.size());
+	for (size_t i = 0; i < quadrics.size(); i++)
+	{
+		quadrics[i].Clear();
+	}
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		glm::dvec3 p0(vertices[indices[i]].Position), p1(vertices[indices[i + 1]].Position), p2(vertices[indices[i + 2]].Position);
+		glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(n);
+		if (length <= 0.0)
+		{
+			continue;
+		}
+		n /= length;
+		double d = -glm::dot(n, p0);
+		for (int k = 0; k < 3; k++)
+		{
+			quadrics[indices[i + k]].AddPlane(n, d, length * 0.5);
+		}
+	}
+
+	vector<uint64_t> cells;
+	vector<GLuint> level;
+	size_t previousCount = triangleCount;
+	for (GLuint l = 0; l < MESH_LOD_MAX - 1; l++)
+	{
+		size_t target = static_cast<size_t>(triangleCount * LOD_TRIANGLE_RATIOS[l]);
+
+		// Finest grid that gets down to the target, found by bisection on the resolution
+		GLuint low = 1, high = LOD_GRID_MAX;
+		while (low < high)
+		{
+			GLuint mid = (low + high + 1) / 2;
+			lodCells(vertices, boundsMin, extent, mid, cells);
+			if (lodSurvivingTriangles(indices, indexCount, cells) <= target)
+			{
+				low = mid;
+			}
+			else
+			{
+				high = mid - 1;
+			}
+		}
+
+		lodCells(vertices, boundsMin, extent, low, cells);
+		lodCluster(vertices, indices, indexCount, quadrics, cells, level);
+
+		size_t levelCount = level.size() / 3;
+		if (levelCount == 0 || levelCount > previousCount * (1.0f - LOD_MIN_REDUCTION))
+		{
+			break;
+		}
+
+		lodOffsets.push_back(static_cast<GLuint>(indices.size()));
+		indices.insert(indices.end(), level.begin(), level.end());
+		previousCount = levelCount;
+	}
+}
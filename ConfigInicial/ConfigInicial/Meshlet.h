@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cmath>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Triangles and distinct vertices a meshlet holds at most
+const GLuint MESHLET_MAX_TRIANGLES = 128;
+const GLuint MESHLET_MAX_VERTICES = 64;
+
+// A cluster of consecutive triangles of a mesh's LOD0 with the bounds needed to cull it on its own.
+// Stored as is in the mesh cache.
+struct Meshlet
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	float center[3];		// Bounding sphere, model space
+	float radius;
+	float coneAxis[3];		// Average facing of the triangles
+	float coneCutoff;		// Sine of the widest angle between the axis and a triangle normal, 1 if the cone is too wide to cull
+};
+
+// What a meshlet is tested against, in the model space of the mesh being drawn
+struct ClusterView
+{
+	glm::vec4 planes[6];	// Frustum planes, pointing inwards, not normalized
+	glm::vec3 eye;
+	bool coneCulling;
+};
+
+// True unless the meshlet is entirely outside the frustum or, with cone culling, only shows back faces to the eye
+bool MeshletVisible(const Meshlet &meshlet, const ClusterView &view)
+{
+	glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+
+	for (int i = 0; i < 6; i++)
+	{
+		glm::vec3 normal(view.planes[i]);
+		if (glm::dot(normal, center) + view.planes[i].w < -meshlet.radius * glm::length(normal))
+		{
+			return false;
+		}
+	}
+
+	if (view.coneCulling)
+	{
+		glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+		glm::vec3 toCenter = center - view.eye;
+		if (glm::dot(toCenter, axis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Camera state of the frame, from which every draw derives its ClusterView
+class ClusterCulling
+{
+public:
+	static ClusterCulling &Instance()
+	{
+		static ClusterCulling culling;
+		return culling;
+	}
+
+	// Call once per frame before drawing. Cone culling follows GL_CULL_FACE: without it back faces are visible.
+	void BeginFrame(const glm::mat4 &viewProjection, const glm::vec3 &eye)
+	{
+		this->viewProjection = viewProjection;
+		this->eye = eye;
+		this->coneCulling = glIsEnabled(GL_CULL_FACE) == GL_TRUE;
+	}
+
+	// The frame's view, moved into the space of a model drawn with the given model matrix
+	ClusterView ViewFor(const glm::mat4 &modelMatrix) const
+	{
+		ClusterView view;
+
+		// The planes of the clip matrix of this draw are the frustum planes in model space (Gribb and Hartmann)
+		glm::mat4 m = this->viewProjection * modelMatrix;
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+		{
+			rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+		}
+		view.planes[0] = rows[3] + rows[0];
+		view.planes[1] = rows[3] - rows[0];
+		view.planes[2] = rows[3] + rows[1];
+		view.planes[3] = rows[3] - rows[1];
+		view.planes[4] = rows[3] + rows[2];
+		view.planes[5] = rows[3] - rows[2];
+
+		view.eye = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(this->eye, 1.0f));
+		view.coneCulling = this->coneCulling;
+		return view;
+	}
+
+private:
+	glm::mat4 viewProjection;
+	glm::vec3 eye;
+	bool coneCulling;
+
+	ClusterCulling() : viewProjection(1.0f), eye(0.0f), coneCulling(false)
+	{
+	}
+};
@@ -5,7 +5,13 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <chrono>
+#include <cfloat>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -16,60 +22,660 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "AssetIOSystem.h"
+#include "ObjParser.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "TextureRegistry.h"
+#include "Hash.h"
+#include "AllocationCounter.h"
 #include  "Shader.h"
 
 using namespace std;
 
-GLint TextureFromFile(const char *path, string directory);
+// Post-processing requested from ASSIMP. Part of the mesh cache key.
+const GLuint MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs;
+
+// Diameter in pixels below which a model switches to LOD1, LOD2 and LOD3
+const float LOD_SCREEN_SIZES[MESH_LOD_MAX - 1] = { 240.0f, 120.0f, 50.0f };
+// Margin around every threshold, as a fraction of it, so an instance at the boundary does not flip levels every frame
+const float LOD_HYSTERESIS = 0.15f;
+
+// What a model keeps in main memory once its meshes are on the GPU
+enum GeometryResidency
+{
+	GEOMETRY_GPU_ONLY,		// Vertices and indices are freed, Geometry() reads them again from the mesh cache
+	GEOMETRY_KEEP_CPU		// Vertices and indices stay in the meshes, e.g. for picking or collisions
+};
+
+// Memory a model takes. Buffers and textures shared with other models count in each of them.
+struct ModelMemory
+{
+	size_t cpuBytes;			// Meshes in main memory
+	size_t gpuGeometryBytes;	// Vertex and index buffers
+	size_t gpuTextureBytes;		// Mip levels of its textures resident on the GPU
+};
 
 class Model
 {
 public:
 	/*  Functions   */
+	// Default constructor, for models loaded in two steps through Import() and Upload() (see ModelLoader)
+	Model() : boundsRadius(0.0f), residency(DefaultResidency()), cached(false), importMs(0.0f)
+	{
+	}
+
 	// Constructor, expects a filepath to a 3D model.
-	Model(GLchar *path)
+	Model(GLchar *path) : boundsRadius(0.0f), residency(DefaultResidency()), cached(false), importMs(0.0f)
+	{
+		this->Import(path);
+		this->Upload();
+	}
+
+	// Gives the shared textures back to the registry
+	~Model()
+	{
+		for (unordered_map<string, GLuint>::iterator it = this->textures_loaded.begin(); it != this->textures_loaded.end(); ++it)
+		{
+			TextureRegistry::Instance().Release(it->second);
+		}
+	}
+
+	// First half of loading: reads the geometry (mesh cache or ASSIMP).
+	// Touches no GL state, so it may run on a worker thread.
+	void Import(const string &path)
 	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		AllocationScope allocations;
 		this->loadModel(path);
+		this->hashTextures();
+		this->importMs = elapsedMs(start);
+
+		if (AllocationScope::Enabled())
+		{
+			ostringstream log;
+			log << "MODEL::ALLOCATIONS:: " << this->path << " " << allocations.Allocations() << " heap allocations, peak "
+				<< allocations.PeakBytes() / 1024 << " KB" << endl;
+			cout << log.str();
+		}
 	}
 
-	// Draws the model, and thus all its meshes
-	void Draw(Shader shader)
+	// Second half of loading: creates the buffers of everything Import() produced and requests its textures,
+	// which are decoded and streamed in by the TextureLoader. Must run on the thread that owns the GL context.
+	void Upload()
 	{
+		if (this->cache.MeshCount() > 0)
+		{
+			// The buffers are filled from the mapped cache, a CPU copy is only made if the geometry stays
+			this->meshes.reserve(this->cache.MeshCount());
+			for (GLuint i = 0; i < this->cache.MeshCount(); i++)
+			{
+				MeshCache::MeshView view = this->cache.GetMesh(i);
+				this->meshes.emplace_back(view.vertices, view.vertexCount, view.indices, view.indexCount, this->loadMaterial(view.textures),
+					view.lodOffsets, view.lodCount, view.meshlets, view.meshletCount, this->residency != GEOMETRY_GPU_ONLY);
+			}
+		}
+		else
+		{
+			// The imported arrays become the meshes' own
+			this->meshes.reserve(this->imported.size());
+			for (GLuint i = 0; i < this->imported.size(); i++)
+			{
+				MeshData &data = this->imported[i];
+				this->meshes.emplace_back(move(data.vertices), move(data.indices), this->loadMaterial(data.textures),
+					move(data.lodOffsets), move(data.meshlets));
+			}
+		}
+
+		// Geometry() reads released meshes back from the cache, so without one they keep their copy
+		if (this->residency == GEOMETRY_GPU_ONLY && this->cached)
+		{
+			for (GLuint i = 0; i < this->meshes.size(); i++)
+			{
+				this->meshes[i].ReleaseGeometry();
+			}
+		}
+
+		// Meshes sharing a material next to each other, so their binds are skipped. The import order is
+		// kept to find a mesh in the cache again.
+		this->meshSources.resize(this->meshes.size());
+		for (GLuint i = 0; i < this->meshSources.size(); i++)
+		{
+			this->meshSources[i] = i;
+		}
+		stable_sort(this->meshSources.begin(), this->meshSources.end(), [this](GLuint a, GLuint b)
+		{
+			return this->meshes[a].material < this->meshes[b].material;
+		});
+		vector<Mesh> sorted;
+		sorted.reserve(this->meshes.size());
+		for (GLuint i = 0; i < this->meshSources.size(); i++)
+		{
+			sorted.push_back(move(this->meshes[this->meshSources[i]]));
+		}
+		this->meshes.swap(sorted);
+
+		this->computeBounds();
+
+		size_t unpackedBytes = 0;
 		for (GLuint i = 0; i < this->meshes.size(); i++)
 		{
-			this->meshes[i].Draw(shader);
+			unpackedBytes += this->meshes[i].UnpackedBytes();
 		}
+		ostringstream log;
+		log << "MODEL::GEOMETRY:: " << this->path << " " << this->GpuBytes() / 1024 << " KB on the GPU (" << unpackedBytes / 1024
+			<< " KB with float vertices and 32-bit indices), " << this->Memory().cpuBytes / 1024 << " KB kept in main memory" << endl;
+		log << "MODEL::LOD:: " << this->path;
+		for (GLuint lod = 0; lod < this->LodCount(); lod++)
+		{
+			GLuint triangles = 0;
+			for (GLuint i = 0; i < this->meshes.size(); i++)
+			{
+				triangles += this->meshes[i].TriangleCount(min(lod, this->meshes[i].LodCount() - 1));
+			}
+			log << (lod > 0 ? " / " : " ") << triangles;
+		}
+		log << " triangles" << endl;
+		cout << log.str();
+
+		// The CPU-side results are no longer needed once they live on the GPU
+		this->imported.clear();
+		this->textureHashes.clear();
+		this->cache.Close();
 	}
 
-private:
-	/*  Model Data  */
-	vector<Mesh> meshes;
-	string directory;
-	vector<Texture> textures_loaded;	// Stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+	// Bytes the vertex and index buffers of all meshes take on the GPU
+	size_t GpuBytes() const
+	{
+		size_t bytes = 0;
+		for (GLuint i = 0; i < this->meshes.size(); i++)
+		{
+			bytes += this->meshes[i].GpuBytes();
+		}
+		return bytes;
+	}
 
-										/*  Functions   */
-										// Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-	void loadModel(string path)
+	// Memory the model takes now, textures counted with the mip levels streamed in so far
+	ModelMemory Memory() const
 	{
+		ModelMemory memory;
+		memory.cpuBytes = this->meshes.capacity() * sizeof(Mesh) + this->meshSources.capacity() * sizeof(GLuint);
+		memory.gpuGeometryBytes = this->GpuBytes();
+		memory.gpuTextureBytes = 0;
+		for (GLuint i = 0; i < this->meshes.size(); i++)
+		{
+			memory.cpuBytes += this->meshes[i].CpuBytes();
+		}
+		for (unordered_map<string, GLuint>::const_iterator it = this->textures_loaded.begin(); it != this->textures_loaded.end(); ++it)
+		{
+			TextureInfo info;
+			if (TextureLoader::Instance().GetInfo(it->second, info))
+			{
+				memory.gpuTextureBytes += info.gpuBytes;
+			}
+		}
+		return memory;
+	}
+
+	// Prints Memory()
+	void ReportMemory() const
+	{
+		ModelMemory memory = this->Memory();
+		ostringstream log;
+		log << "MODEL::MEMORY:: " << this->path << " " << memory.cpuBytes / 1024 << " KB in main memory, "
+			<< memory.gpuGeometryBytes / 1024 << " KB of buffers and " << memory.gpuTextureBytes / 1024 << " KB of textures on the GPU" << endl;
+		cout << log.str();
+	}
+
+	// Vertices and indices of a mesh, every level of detail one after the other as in the mesh cache. Meshes that
+	// released theirs are read again from the cache, so the model's files must not have changed since it was imported.
+	// Returns false if the geometry is not available.
+	bool Geometry(GLuint mesh, MeshData &data) const
+	{
+		if (mesh >= this->meshes.size())
+		{
+			return false;
+		}
+
+		const Mesh &source = this->meshes[mesh];
+		if (source.HasGeometry())
+		{
+			data.vertices = source.vertices;
+			data.indices = source.indices;
+			data.lodOffsets = source.LodOffsets();
+			return true;
+		}
+
+		MeshCache cache;
+		if (!cache.Open(this->path, MODEL_IMPORT_FLAGS, ImportSettingsHash()) || this->meshSources[mesh] >= cache.MeshCount())
+		{
+			cout << "ERROR::MODEL::GEOMETRY_NOT_CACHED " << this->path << endl;
+			return false;
+		}
+		MeshCache::MeshView view = cache.GetMesh(this->meshSources[mesh]);
+		data.vertices.assign(view.vertices, view.vertices + view.vertexCount);
+		data.indices.assign(view.indices, view.indices + view.indexCount);
+		data.lodOffsets.assign(view.lodOffsets, view.lodOffsets + view.lodCount);
+		return true;
+	}
+
+	GLuint MeshCount() const
+	{
+		return static_cast<GLuint>(this->meshes.size());
+	}
+
+	// Residency of the models created from now on
+	static GeometryResidency &DefaultResidency()
+	{
+		static GeometryResidency residency = GEOMETRY_GPU_ONLY;
+		return residency;
+	}
+
+	// Residency of this model's meshes, to be set before Upload()
+	void SetResidency(GeometryResidency residency)
+	{
+		this->residency = residency;
+	}
+
+	// Tolerance of the vertex welding done at import, for the models imported from now on
+	static WeldTolerance &Weld()
+	{
+		static WeldTolerance tolerance = { 1e-5f, 1e-3f, 1e-5f };
+		return tolerance;
+	}
+
+	// Whether OBJ files are read by ObjParser rather than ASSIMP, for the models imported from now on
+	static bool &ObjParserEnabled()
+	{
+		static bool enabled = true;
+		return enabled;
+	}
+
+	// Hash of the import settings other than MODEL_IMPORT_FLAGS, part of the mesh cache key
+	static uint64_t ImportSettingsHash()
+	{
+		return Hash64(&Weld(), sizeof(WeldTolerance), ObjParserEnabled() ? 1 : 0);
+	}
+
+	// Reads the meshes of a model file as they come, before welding and optimizing. OBJ files go through ObjParser
+	// when objParser is set; everything else, and the OBJ files it cannot read, through ASSIMP. Both read from the
+	// asset pack when there is one. dependencies, if given, receives the other files read, such as MTL libraries.
+	static bool ReadMeshes(const string &path, bool objParser, vector<MeshData> &meshes, vector<string> *dependencies = nullptr)
+	{
+		string extension = path.substr(path.find_last_of('.') + 1);
+		transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (objParser && extension == "obj")
+		{
+			if (ObjParser::Parse(path, meshes, dependencies))
+			{
+				return true;
+			}
+			meshes.clear();
+			if (dependencies)
+			{
+				dependencies->clear();
+			}
+			cout << "MODEL::LOAD::ASSIMP_FALLBACK " << path << endl;
+		}
+
 		// Read file via ASSIMP
 		Assimp::Importer importer;
-		const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+		AssetIOSystem *io = new AssetIOSystem();
+		importer.SetIOHandler(io);
+		const aiScene *scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+		for (size_t i = 0; dependencies && i < io->Opened().size(); i++)
+		{
+			if (io->Opened()[i] != path && find(dependencies->begin(), dependencies->end(), io->Opened()[i]) == dependencies->end())
+			{
+				dependencies->push_back(io->Opened()[i]);
+			}
+		}
 
 		// Check for errors
 		if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
 		{
 			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+			return false;
+		}
+
+		// Process ASSIMP's root node recursively
+		meshes.reserve(scene->mNumMeshes);
+		processNode(scene->mRootNode, scene, meshes);
+		return true;
+	}
+
+	// Image files referenced by the materials of the model, known between Import() and Upload()
+	vector<string> TextureFiles() const
+	{
+		vector<string> files;
+		for (map<string, uint64_t>::const_iterator it = this->textureHashes.begin(); it != this->textureHashes.end(); ++it)
+		{
+			files.push_back(this->directory + '/' + it->first);
+		}
+		return files;
+	}
+
+	// Whether the model draws with the image at this normalized path
+	bool UsesTexture(const string &key) const
+	{
+		for (unordered_map<string, GLuint>::const_iterator it = this->textures_loaded.begin(); it != this->textures_loaded.end(); ++it)
+		{
+			if (NormalizePath(this->directory + '/' + it->first) == key)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Path the model was imported from
+	const string &Path() const
+	{
+		return this->path;
+	}
+
+	// Takes over the meshes and textures of another model, uploaded already, e.g. a newer import of the same file.
+	// The current meshes are deleted and the textures go to the other model, to be released along with it.
+	// Must be called on the GL context thread, between two frames.
+	void Replace(Model &other)
+	{
+		for (GLuint i = 0; i < this->meshes.size(); i++)
+		{
+			this->meshes[i].Release();
+		}
+		this->meshes.clear();
+		this->meshes.swap(other.meshes);
+		this->meshSources.swap(other.meshSources);
+		this->cached = other.cached;
+		this->textures_loaded.swap(other.textures_loaded);
+		this->boundsCenter = other.boundsCenter;
+		this->boundsRadius = other.boundsRadius;
+		this->importMs = other.importMs;
+	}
+
+	// Milliseconds spent in Import()
+	float ImportTime() const
+	{
+		return this->importMs;
+	}
+
+	// Levels of detail of the mesh that has the most
+	GLuint LodCount() const
+	{
+		GLuint count = 1;
+		for (GLuint i = 0; i < this->meshes.size(); i++)
+		{
+			count = max(count, this->meshes[i].LodCount());
+		}
+		return count;
+	}
+
+	// Diameter in pixels the bounding sphere of the model covers on screen, FLT_MAX with the eye inside it.
+	// lodScale is projection[1][1] times the viewport height in pixels.
+	float ScreenSize(const glm::mat4 &modelMatrix, const glm::vec3 &eye, float lodScale) const
+	{
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(this->boundsCenter, 1.0f));
+		float scale = max(glm::length(glm::vec3(modelMatrix[0])), max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+		float radius = this->boundsRadius * scale;
+		float distance = glm::length(center - eye);
+		if (distance <= radius)
+		{
+			return FLT_MAX;
+		}
+		// Diameter 2r over a view height of 2d tan(fovy / 2), with projection[1][1] = 1 / tan(fovy / 2)
+		return radius / distance * lodScale;
+	}
+
+	// Level of detail to draw the model with, from its ScreenSize(). current is the level used last frame.
+	GLuint SelectLod(float size, GLuint current) const
+	{
+		// Move to a finer level once clearly above its threshold, to a coarser one once clearly below
+		GLuint lod = min(current, this->LodCount() - 1);
+		while (lod > 0 && size > LOD_SCREEN_SIZES[lod - 1] * (1.0f + LOD_HYSTERESIS))
+		{
+			lod--;
+		}
+		while (lod + 1 < this->LodCount() && size < LOD_SCREEN_SIZES[lod] * (1.0f - LOD_HYSTERESIS))
+		{
+			lod++;
+		}
+		return lod;
+	}
+
+	// Asks the TextureLoader for mip levels of the model's textures sharp enough for its ScreenSize() this frame
+	void StreamTextures(float size) const
+	{
+		for (unordered_map<string, GLuint>::const_iterator it = this->textures_loaded.begin(); it != this->textures_loaded.end(); ++it)
+		{
+			TextureLoader::Instance().Touch(it->second, size);
+		}
+	}
+
+	// Draws the model, and thus all its meshes, at the given level of detail
+	void Draw(Shader &shader, GLuint lod = 0)
+	{
+		for (GLuint i = 0; i < this->meshes.size(); i++)
+		{
+			this->meshes[i].Draw(shader, lod);
+		}
+	}
+
+	// Same, culling the meshlets of LOD0 against the frame's ClusterCulling. modelMatrix must be the one the shader uses.
+	void Draw(Shader &shader, GLuint lod, const glm::mat4 &modelMatrix)
+	{
+		ClusterView view = ClusterCulling::Instance().ViewFor(modelMatrix);
+		for (GLuint i = 0; i < this->meshes.size(); i++)
+		{
+			this->meshes[i].Draw(shader, lod, &view);
+		}
+	}
+
+	// Draws count instances of the model at the given level of detail, one instanced draw per mesh. The shader must
+	// read the model matrix from the instance attributes (see lighting_instanced.vs).
+	void DrawInstanced(Shader &shader, GLuint lod, const glm::mat4 *modelMatrices, GLsizei count)
+	{
+		if (count == 0)
+		{
 			return;
 		}
+
+		InstanceBuffer::Instance().Upload(modelMatrices, count);
+		for (GLuint i = 0; i < this->meshes.size(); i++)
+		{
+			this->meshes[i].DrawInstanced(shader, lod, count);
+		}
+	}
+
+	// Whether the bounding sphere of the model placed with this matrix is at least partly inside the frame's frustum
+	bool Visible(const glm::mat4 &modelMatrix) const
+	{
+		ClusterView view = ClusterCulling::Instance().ViewFor(modelMatrix);
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal(view.planes[i]);
+			if (glm::dot(normal, this->boundsCenter) + view.planes[i].w < -this->boundsRadius * glm::length(normal))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	/*  Model Data  */
+	vector<Mesh> meshes;
+	string path;
+	string directory;
+	unordered_map<string, GLuint> textures_loaded;	// Textures this model holds a registry reference to, keyed by the path the material uses.
+	glm::vec3 boundsCenter;		// Bounding sphere of all meshes, in model space
+	float boundsRadius;
+	GeometryResidency residency;
+	vector<GLuint> meshSources;		// Index in the mesh cache of every mesh
+	bool cached;					// Whether the mesh cache holds this import, read or written by Import()
+
+	// Results of Import() waiting for Upload()
+	MeshCache cache;					// Open on a warm start
+	vector<MeshData> imported;			// Filled on a cold start
+	map<string, uint64_t> textureHashes;	// Content hash of every referenced texture file
+	float importMs;
+
+	// The destructor gives back registry references a copy would share, so models are not copied
+	Model(const Model &);
+	Model &operator=(const Model &);
+
+										/*  Functions   */
+										// Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+	void loadModel(string path)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
 		// Retrieve the directory path of the filepath
+		this->path = path;
 		this->directory = path.substr(0, path.find_last_of('/'));
 
-		// Process ASSIMP's root node recursively
-		this->processNode(scene->mRootNode, scene);
+		// Warm start: the meshes are read straight from the memory-mapped cache
+		uint64_t settingsHash = ImportSettingsHash();
+		this->cached = false;
+		if (this->cache.Open(path, MODEL_IMPORT_FLAGS, settingsHash))
+		{
+			this->cached = true;
+			ImportStats stats = this->cache.Stats();
+			ostringstream log;
+			log << "MODEL::LOAD::CACHE_HIT " << path << " " << elapsedMs(start) << " ms (cold " << stats.coldLoadMs << " ms)" << endl;
+			cout << log.str();
+			logWeld(stats);
+			logVertexCache(stats);
+			return;
+		}
+
+		vector<string> dependencies;
+		if (!ReadMeshes(path, ObjParserEnabled(), this->imported, &dependencies))
+		{
+			return;
+		}
+
+		// OBJ files give every face corner its own vertex, collapse the copies
+		ImportStats stats;
+		stats.verticesImported = stats.verticesWelded = 0;
+		for (GLuint i = 0; i < this->imported.size(); i++)
+		{
+			stats.verticesImported += static_cast<uint32_t>(this->imported[i].vertices.size());
+			WeldVertices(this->imported[i].vertices, this->imported[i].indices, Weld());
+			stats.verticesWelded += static_cast<uint32_t>(this->imported[i].vertices.size());
+		}
+
+		// Simplified levels of detail go after the full mesh in the same index array. Then every level is reordered for
+		// the post-transform cache, and the vertices for fetch locality.
+		VertexCacheStats before = analyzeVertexCache(this->imported);
+		for (GLuint i = 0; i < this->imported.size(); i++)
+		{
+			MeshData &mesh = this->imported[i];
+			GenerateLods(mesh.vertices, mesh.indices, mesh.lodOffsets);
+			for (GLuint lod = 0; lod < mesh.lodOffsets.size(); lod++)
+			{
+				size_t end = lod + 1 < mesh.lodOffsets.size() ? mesh.lodOffsets[lod + 1] : mesh.indices.size();
+				OptimizeVertexCache(mesh.indices.data() + mesh.lodOffsets[lod], end - mesh.lodOffsets[lod], mesh.vertices.size());
+			}
+			OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+			// Clusters of LOD0 for culling, in the order the cache optimization left the triangles
+			GLuint lod0Count = static_cast<GLuint>(mesh.lodOffsets.size() > 1 ? mesh.lodOffsets[1] : mesh.indices.size());
+			BuildMeshlets(mesh.vertices, mesh.indices, 0, lod0Count, mesh.meshlets);
+		}
+		VertexCacheStats after = analyzeVertexCache(this->imported);
+		stats.acmrBefore = before.ACMR();
+		stats.atvrBefore = before.ATVR();
+		stats.acmrAfter = after.ACMR();
+		stats.atvrAfter = after.ATVR();
+
+		stats.coldLoadMs = elapsedMs(start);
+		this->cached = MeshCache::Write(path, MODEL_IMPORT_FLAGS, settingsHash, dependencies, this->imported, stats);
+
+		ostringstream log;
+		log << "MODEL::LOAD::CACHE_MISS " << path << " " << stats.coldLoadMs << " ms" << endl;
+		cout << log.str();
+		logWeld(stats);
+		logVertexCache(stats);
+	}
+
+	// Vertex cache efficiency of the full detail level of all meshes together
+	static VertexCacheStats analyzeVertexCache(const vector<MeshData> &meshes)
+	{
+		VertexCacheStats total;
+		total.triangles = total.vertices = total.misses = 0;
+		for (GLuint i = 0; i < meshes.size(); i++)
+		{
+			size_t indexCount = meshes[i].lodOffsets.size() > 1 ? meshes[i].lodOffsets[1] : meshes[i].indices.size();
+			VertexCacheStats stats = AnalyzeVertexCache(meshes[i].indices.data(), indexCount, meshes[i].vertices.size());
+			total.triangles += stats.triangles;
+			total.vertices += stats.vertices;
+			total.misses += stats.misses;
+		}
+		return total;
+	}
+
+	void logWeld(const ImportStats &stats) const
+	{
+		ostringstream log;
+		log << "MODEL::WELD:: " << this->path << " " << stats.verticesImported << " -> " << stats.verticesWelded << " vertices ("
+			<< stats.verticesImported - stats.verticesWelded << " removed)" << endl;
+		cout << log.str();
+	}
+
+	void logVertexCache(const ImportStats &stats) const
+	{
+		ostringstream log;
+		log << "MODEL::OPTIMIZE:: " << this->path << " ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter
+			<< ", ATVR " << stats.atvrBefore << " -> " << stats.atvrAfter << endl;
+		cout << log.str();
+	}
+
+	// Bounding sphere around the bounding boxes of all meshes
+	void computeBounds()
+	{
+		if (this->meshes.empty())
+		{
+			this->boundsCenter = glm::vec3(0.0f);
+			this->boundsRadius = 0.0f;
+			return;
+		}
+
+		glm::vec3 boundsMin = this->meshes[0].BoundsMin(), boundsMax = this->meshes[0].BoundsMax();
+		for (GLuint i = 1; i < this->meshes.size(); i++)
+		{
+			boundsMin = glm::min(boundsMin, this->meshes[i].BoundsMin());
+			boundsMax = glm::max(boundsMax, this->meshes[i].BoundsMax());
+		}
+		this->boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		this->boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+	}
+
+	// Hashes the contents of every texture file the meshes reference, so copies of an image in other folders share one texture
+	void hashTextures()
+	{
+		vector<TextureRef> refs;
+		for (GLuint i = 0; i < this->cache.MeshCount(); i++)
+		{
+			MeshCache::MeshView view = this->cache.GetMesh(i);
+			refs.insert(refs.end(), make_move_iterator(view.textures.begin()), make_move_iterator(view.textures.end()));
+		}
+		for (GLuint i = 0; i < this->imported.size(); i++)
+		{
+			refs.insert(refs.end(), this->imported[i].textures.begin(), this->imported[i].textures.end());
+		}
+
+		for (GLuint i = 0; i < refs.size(); i++)
+		{
+			if (!this->textureHashes.count(refs[i].path))
+			{
+				this->textureHashes[refs[i].path] = HashFile(this->directory + '/' + refs[i].path);
+			}
+		}
 	}
 
 	// Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(aiNode* node, const aiScene* scene)
+	static void processNode(aiNode* node, const aiScene* scene, vector<MeshData> &meshData)
 	{
 		// Process each mesh located at the current node
 		for (GLuint i = 0; i < node->mNumMeshes; i++)
@@ -78,22 +684,26 @@ private:
 			// The scene contains all the data, node is just to keep stuff organized (like relations between nodes).
 			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
 
-			this->meshes.push_back(this->processMesh(mesh, scene));
+			meshData.push_back(processMesh(mesh, scene));
 		}
 
 		// After we've processed all of the meshes (if any) we then recursively process each of the children nodes
 		for (GLuint i = 0; i < node->mNumChildren; i++)
 		{
-			this->processNode(node->mChildren[i], scene);
+			processNode(node->mChildren[i], scene, meshData);
 		}
 	}
 
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+	static MeshData processMesh(aiMesh *mesh, const aiScene *scene)
 	{
 		// Data to fill
-		vector<Vertex> vertices;
-		vector<GLuint> indices;
-		vector<Texture> textures;
+		MeshData data;
+		vector<Vertex> &vertices = data.vertices;
+		vector<GLuint> &indices = data.indices;
+		vector<TextureRef> &textures = data.textures;
+
+		vertices.reserve(mesh->mNumVertices);
+		indices.reserve(mesh->mNumFaces * 3);
 
 		// Walk through each of the mesh's vertices
 		for (GLuint i = 0; i < mesh->mNumVertices; i++)
@@ -154,83 +764,61 @@ private:
 			// Normal: texture_normalN
 
 			// 1. Diffuse maps
-			vector<Texture> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-			textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+			getMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
 
 			// 2. Specular maps
-			vector<Texture> specularMaps = this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-			textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+			getMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
 		}
 
-		// Return a mesh object created from the extracted mesh data
-		return Mesh(vertices, indices, textures);
+		// Return the extracted mesh data, the Mesh itself is created once the textures are resolved
+		return data;
 	}
 
-	// Checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// The required info is returned as a Texture struct.
-	vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+	// Collects the texture paths of a given type referenced by a material
+	static void getMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<TextureRef> &textures)
 	{
-		vector<Texture> textures;
-
 		for (GLuint i = 0; i < mat->GetTextureCount(type); i++)
 		{
 			aiString str;
 			mat->GetTexture(type, i, &str);
 
-			// Check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-			GLboolean skip = false;
-
-			for (GLuint j = 0; j < textures_loaded.size(); j++)
-			{
-				if (textures_loaded[j].path == str)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true; // A texture with the same filepath has already been loaded, continue to next one. (optimization)
+			TextureRef ref;
+			ref.type = typeName;
+			ref.path = str.C_Str();
+			textures.push_back(ref);
+		}
+	}
 
-					break;
-				}
-			}
+	// Checks all texture references of a mesh and loads the textures if they're not loaded yet.
+	// Returns the material made of them.
+	MaterialID loadMaterial(const vector<TextureRef> &refs)
+	{
+		vector<string> types;
+		vector<GLuint> textures;
 
-			if (!skip)
-			{   // If texture hasn't been loaded already, load it
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
-				texture.type = typeName;
-				texture.path = str;
-				textures.push_back(texture);
+		for (GLuint i = 0; i < refs.size(); i++)
+		{
+			types.push_back(refs[i].type);
 
-				this->textures_loaded.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+			// Check if texture was loaded before and if so, reuse it: skip acquiring it again
+			unordered_map<string, GLuint>::iterator loaded = this->textures_loaded.find(refs[i].path);
+			if (loaded != this->textures_loaded.end())
+			{
+				textures.push_back(loaded->second);
+				continue;
 			}
+
+			// Otherwise take it from the registry, which shares it with every other model using the same image
+			GLuint textureID = TextureRegistry::Instance().Acquire(this->directory + '/' + refs[i].path, this->textureHashes[refs[i].path]);
+			textures.push_back(textureID);
+			this->textures_loaded[refs[i].path] = textureID;
 		}
 
-		return textures;
+		return MaterialRegistry::Instance().Acquire(types, textures);
 	}
-};
 
-GLint TextureFromFile(const char *path, string directory)
-{
-	//Generate texture ID and load texture data
-	string filename = string(path);
-	filename = directory + '/' + filename;
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height;
-
-	unsigned char *image = SOIL_load_image(filename.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
-
-	// Assign texture to ID
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// Parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	SOIL_free_image_data(image);
-
-	return textureID;
-}
\ No newline at end of file
+	static float elapsedMs(chrono::high_resolution_clock::time_point start)
+	{
+		return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+	}
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "Model.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Loads a batch of models concurrently. Import() (disk I/O, ASSIMP, image decoding) runs on the
+// worker pool, while Upload() is funneled back to the thread that owns the GL context.
+class ModelLoader
+{
+public:
+	// Queues a model to be loaded from the given path by the next Run()
+	void Add(Model &model, const string &path)
+	{
+		Request request;
+		request.model = &model;
+		request.path = path;
+		this->requests.push_back(request);
+	}
+
+	// Loads every queued model and returns once all of them are uploaded. Must be called on the GL context thread.
+	void Run(ThreadPool &pool = ThreadPool::Shared())
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+		mutex readyMutex;
+		condition_variable readyChanged;
+		deque<size_t> ready;
+
+		for (size_t i = 0; i < this->requests.size(); i++)
+		{
+			Request *request = &this->requests[i];
+			pool.Submit([request, i, &readyMutex, &readyChanged, &ready]
+			{
+				request->model->Import(request->path);
+
+				lock_guard<mutex> lock(readyMutex);
+				ready.push_back(i);
+				readyChanged.notify_one();
+			});
+		}
+
+		// Upload each model as soon as its import finishes, so GL work overlaps the remaining imports
+		float importSum = 0.0f;
+		for (size_t uploaded = 0; uploaded < this->requests.size(); uploaded++)
+		{
+			size_t i;
+			{
+				unique_lock<mutex> lock(readyMutex);
+				readyChanged.wait(lock, [&ready] { return !ready.empty(); });
+				i = ready.front();
+				ready.pop_front();
+			}
+
+			this->requests[i].model->Upload();
+			importSum += this->requests[i].model->ImportTime();
+		}
+
+		float totalMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+		ostringstream log;
+		log << "MODEL::LOADER:: " << this->requests.size() << " models on " << pool.Size() << " threads in " << totalMs
+			<< " ms (sum of per-model imports " << importSum << " ms)" << endl;
+		cout << log.str();
+
+		this->requests.clear();
+	}
+
+private:
+	struct Request
+	{
+		Model *model;
+		string path;
+	};
+
+	vector<Request> requests;
+};
@@ -0,0 +1,636 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+
+#include <glm/glm.hpp>
+
+#include "MeshCache.h"
+#include "AssetPack.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Bytes of OBJ text parsed by one task. Chunks end at a line break.
+const size_t OBJ_PARSER_CHUNK_SIZE = 1024 * 1024;
+
+// Reads Wavefront OBJ files and their MTL libraries straight into MeshData, without building a scene first.
+// The mapped file is split into chunks parsed in parallel; a sequential pass then lays out the meshes and the
+// chunks write their vertices into them in parallel again. The result matches what Model made of the ASSIMP
+// import with MODEL_IMPORT_FLAGS: a mesh per run of faces with the same object and material, polygons
+// triangulated as fans, V flipped and one vertex per face corner, welded later like the ASSIMP ones.
+class ObjParser
+{
+public:
+	// Returns false, with the reason logged, if the file cannot be read or uses something this parser does not
+	// understand. meshes is undefined then. libraryPaths, if given, receives the path of every MTL library named.
+	static bool Parse(const string &path, vector<MeshData> &meshes, vector<string> *libraryPaths = nullptr, ThreadPool &pool = ThreadPool::Shared())
+	{
+		AssetFile file;
+		if (!file.Open(path))
+		{
+			cout << "ERROR::OBJ::CANNOT_OPEN " << path << endl;
+			return false;
+		}
+
+		// Line-aligned chunks
+		const char *text = reinterpret_cast<const char *>(file.Data());
+		const char *textEnd = text + file.Size();
+		vector<const char *> bounds(1, text);
+		while (bounds.back() < textEnd)
+		{
+			const char *end = bounds.back() + min<size_t>(OBJ_PARSER_CHUNK_SIZE, textEnd - bounds.back());
+			const char *lineEnd = end < textEnd ? static_cast<const char *>(memchr(end, '\n', textEnd - end)) : nullptr;
+			bounds.push_back(lineEnd ? lineEnd + 1 : textEnd);
+		}
+
+		vector<Chunk> chunks(bounds.size() - 1);
+		pool.ParallelFor(chunks.size(), 1, [&chunks, &bounds](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+			}
+		});
+
+		// Global attribute arrays; chunk-relative (negative) indices become global ones
+		vector<glm::vec3> positions, normals;
+		vector<glm::vec2> texCoords;
+		vector<string> libraries;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			Chunk &chunk = chunks[i];
+			if (!chunk.error.empty())
+			{
+				cout << "ERROR::OBJ::" << chunk.error << " " << path << endl;
+				return false;
+			}
+			chunk.positionBase = positions.size();
+			chunk.texCoordBase = texCoords.size();
+			chunk.normalBase = normals.size();
+			positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+			texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+			normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+			libraries.insert(libraries.end(), chunk.libraries.begin(), chunk.libraries.end());
+		}
+
+		// Lay out the meshes: a new one wherever the object or the material changes
+		vector<string> meshMaterials;
+		vector<size_t> meshSizes;
+		string material;
+		bool split = true;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			Chunk &chunk = chunks[i];
+			for (size_t s = 0; s < chunk.segments.size(); s++)
+			{
+				Segment &segment = chunk.segments[s];
+				if (segment.newObject)
+				{
+					split = true;
+				}
+				if (segment.setsMaterial && segment.material != material)
+				{
+					material = segment.material;
+					split = true;
+				}
+
+				size_t cornerEnd = s + 1 < chunk.segments.size() ? chunk.segments[s + 1].firstCorner : chunk.corners.size();
+				segment.cornerCount = cornerEnd - segment.firstCorner;
+				if (segment.cornerCount == 0)
+				{
+					continue;
+				}
+				if (split)
+				{
+					meshMaterials.push_back(material);
+					meshSizes.push_back(0);
+					split = false;
+				}
+				segment.mesh = meshSizes.size() - 1;
+				segment.meshOffset = meshSizes.back();
+				meshSizes.back() += segment.cornerCount;
+			}
+		}
+
+		map<string, vector<TextureRef> > materials;
+		size_t slash = path.find_last_of('/');
+		string directory = slash == string::npos ? "." : path.substr(0, slash);
+		for (size_t i = 0; i < libraries.size(); i++)
+		{
+			parseLibrary(directory + '/' + libraries[i], materials);
+			if (libraryPaths)
+			{
+				libraryPaths->push_back(directory + '/' + libraries[i]);
+			}
+		}
+
+		meshes.clear();
+		meshes.resize(meshSizes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].vertices.resize(meshSizes[i]);
+			meshes[i].indices.resize(meshSizes[i]);
+			map<string, vector<TextureRef> >::const_iterator found = materials.find(meshMaterials[i]);
+			if (found != materials.end())
+			{
+				meshes[i].textures = found->second;
+			}
+		}
+
+		// Every chunk writes the vertices of its own faces, disjoint ranges of the meshes
+		atomic<bool> valid(true);
+		pool.ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (!writeVertices(chunks[i], positions, texCoords, normals, meshes))
+				{
+					valid = false;
+				}
+			}
+		});
+		if (!valid)
+		{
+			cout << "ERROR::OBJ::INDEX_OUT_OF_RANGE " << path << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	// Face corner as written in the file. Non-negative values are global 0-based indices and ABSENT means the
+	// corner has no such attribute. Negative OBJ indices count back from the last attribute read, which may be in an
+	// earlier chunk: they are stored relative to the chunk's first attribute, minus CHUNK_RELATIVE.
+	struct Corner
+	{
+		int64_t position;
+		int64_t texCoord;
+		int64_t normal;
+	};
+
+	static const int64_t ABSENT = -1;
+	static const int64_t CHUNK_RELATIVE = int64_t(1) << 40;
+
+	// Faces of a chunk that share the object and material state. Only the first segment of a chunk inherits both
+	// from the chunks before.
+	struct Segment
+	{
+		bool newObject;			// Starts at an o or g line
+		bool setsMaterial;		// Starts at a usemtl line
+		string material;
+		size_t firstCorner;
+		size_t cornerCount;		// Filled during the layout
+		size_t mesh;
+		size_t meshOffset;		// First vertex in the mesh
+	};
+
+	struct Chunk
+	{
+		vector<glm::vec3> positions;
+		vector<glm::vec2> texCoords;
+		vector<glm::vec3> normals;
+		vector<Corner> corners;			// Three per triangle
+		vector<Segment> segments;
+		vector<string> libraries;
+		string error;
+		size_t positionBase;
+		size_t texCoordBase;
+		size_t normalBase;
+	};
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	static void skipSpaces(const char *&p, const char *end)
+	{
+		while (p < end && isSpace(*p))
+		{
+			p++;
+		}
+	}
+
+	// Rest of the line without surrounding spaces
+	static string restOfLine(const char *p, const char *end)
+	{
+		skipSpaces(p, end);
+		while (end > p && isSpace(end[-1]))
+		{
+			end--;
+		}
+		return string(p, end);
+	}
+
+	// Decimal float as OBJ exporters write them, without going through the locale-aware strtod
+	static bool parseFloat(const char *&p, const char *end, float &value)
+	{
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		skipSpaces(p, end);
+		const char *start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		// Up to 19 significant digits, the rest only moves the decimal point
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		bool digits = false;
+		for (; p < end && isDigit(*p); p++, digits = true)
+		{
+			if (mantissa < 1000000000000000000ULL)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+			}
+			else
+			{
+				exponent++;
+			}
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && isDigit(*p); p++, digits = true)
+			{
+				if (mantissa < 1000000000000000000ULL)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					exponent--;
+				}
+			}
+		}
+		if (!digits)
+		{
+			p = start;
+			return false;
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char *e = p + 1;
+			bool negativeExponent = false;
+			if (e < end && (*e == '-' || *e == '+'))
+			{
+				negativeExponent = *e == '-';
+				e++;
+			}
+			if (e < end && isDigit(*e))
+			{
+				int written = 0;
+				for (; e < end && isDigit(*e); e++)
+				{
+					written = min(written * 10 + (*e - '0'), 10000);
+				}
+				exponent += negativeExponent ? -written : written;
+				p = e;
+			}
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (exponent < 0)
+		{
+			result = -exponent <= 22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+		}
+		else if (exponent > 0)
+		{
+			result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+		}
+		value = static_cast<float>(negative ? -result : result);
+		return true;
+	}
+
+	static bool parseIndex(const char *&p, const char *end, int64_t &index)
+	{
+		bool negative = false;
+		if (p < end && *p == '-')
+		{
+			negative = true;
+			p++;
+		}
+		if (p >= end || !isDigit(*p))
+		{
+			return false;
+		}
+		index = 0;
+		for (; p < end && isDigit(*p); p++)
+		{
+			index = min<int64_t>(index * 10 + (*p - '0'), INT32_MAX);
+		}
+		if (negative)
+		{
+			index = -index;
+		}
+		return index != 0;
+	}
+
+	// Turns a 1-based OBJ index into a Corner value. chunkCount is the number of such attributes the chunk read so far.
+	static int64_t cornerIndex(int64_t index, size_t chunkCount)
+	{
+		return index > 0 ? index - 1 : static_cast<int64_t>(chunkCount) + index - CHUNK_RELATIVE;
+	}
+
+	static bool parseCorner(const char *&p, const char *end, const Chunk &chunk, Corner &corner)
+	{
+		int64_t index;
+		if (!parseIndex(p, end, index))
+		{
+			return false;
+		}
+		corner.position = cornerIndex(index, chunk.positions.size());
+		corner.texCoord = corner.normal = ABSENT;
+		if (p < end && *p == '/')
+		{
+			p++;
+			if (p < end && *p != '/')
+			{
+				if (!parseIndex(p, end, index))
+				{
+					return false;
+				}
+				corner.texCoord = cornerIndex(index, chunk.texCoords.size());
+			}
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (!parseIndex(p, end, index))
+				{
+					return false;
+				}
+				corner.normal = cornerIndex(index, chunk.normals.size());
+			}
+		}
+		return p >= end || isSpace(*p);
+	}
+
+	static void parseChunk(const char *p, const char *end, Chunk &chunk)
+	{
+		Segment first = { false, false, string(), 0, 0, 0, 0 };
+		chunk.segments.push_back(first);
+		vector<Corner> polygon;
+
+		while (p < end && chunk.error.empty())
+		{
+			const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+			if (!lineEnd)
+			{
+				lineEnd = end;
+			}
+			skipSpaces(p, lineEnd);
+
+			// Keyword
+			const char *keyword = p;
+			while (p < lineEnd && !isSpace(*p))
+			{
+				p++;
+			}
+			size_t length = p - keyword;
+
+			if (length == 1 && keyword[0] == 'v')
+			{
+				glm::vec3 position;
+				if (!parseFloat(p, lineEnd, position.x) || !parseFloat(p, lineEnd, position.y) || !parseFloat(p, lineEnd, position.z))
+				{
+					chunk.error = "BAD_VERTEX";
+				}
+				chunk.positions.push_back(position);
+			}
+			else if (length == 2 && keyword[0] == 'v' && keyword[1] == 't')
+			{
+				glm::vec2 texCoord(0.0f);
+				if (!parseFloat(p, lineEnd, texCoord.x))
+				{
+					chunk.error = "BAD_TEXCOORD";
+				}
+				parseFloat(p, lineEnd, texCoord.y);
+				chunk.texCoords.push_back(texCoord);
+			}
+			else if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+			{
+				glm::vec3 normal;
+				if (!parseFloat(p, lineEnd, normal.x) || !parseFloat(p, lineEnd, normal.y) || !parseFloat(p, lineEnd, normal.z))
+				{
+					chunk.error = "BAD_NORMAL";
+				}
+				chunk.normals.push_back(normal);
+			}
+			else if (length == 1 && keyword[0] == 'f')
+			{
+				polygon.clear();
+				for (skipSpaces(p, lineEnd); p < lineEnd; skipSpaces(p, lineEnd))
+				{
+					Corner corner;
+					if (!parseCorner(p, lineEnd, chunk, corner))
+					{
+						chunk.error = "BAD_FACE";
+						break;
+					}
+					polygon.push_back(corner);
+				}
+
+				// Points and lines are not drawn
+				for (size_t i = 2; i < polygon.size(); i++)
+				{
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[i - 1]);
+					chunk.corners.push_back(polygon[i]);
+				}
+			}
+			else if ((length == 1 && (keyword[0] == 'o' || keyword[0] == 'g')) || (length == 6 && memcmp(keyword, "usemtl", 6) == 0))
+			{
+				if (chunk.segments.back().firstCorner != chunk.corners.size())
+				{
+					Segment segment = { false, false, string(), chunk.corners.size(), 0, 0, 0 };
+					chunk.segments.push_back(segment);
+				}
+				Segment &segment = chunk.segments.back();
+				if (length == 1)
+				{
+					segment.newObject = true;
+				}
+				else
+				{
+					segment.setsMaterial = true;
+					segment.material = restOfLine(p, lineEnd);
+				}
+			}
+			else if (length == 6 && memcmp(keyword, "mtllib", 6) == 0)
+			{
+				chunk.libraries.push_back(restOfLine(p, lineEnd));
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	// Reads the texture maps of every material in an MTL file. A missing library leaves its materials untextured.
+	static void parseLibrary(const string &path, map<string, vector<TextureRef> > &materials)
+	{
+		AssetFile file;
+		if (!file.Open(path))
+		{
+			cout << "ERROR::OBJ::MISSING_MTL " << path << endl;
+			return;
+		}
+
+		// Diffuse map first, then specular, as the ASSIMP import listed them
+		map<string, pair<string, string> > maps;
+		pair<string, string> *current = nullptr;
+		const char *p = reinterpret_cast<const char *>(file.Data());
+		const char *end = p + file.Size();
+		while (p < end)
+		{
+			const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+			if (!lineEnd)
+			{
+				lineEnd = end;
+			}
+			skipSpaces(p, lineEnd);
+			const char *keyword = p;
+			while (p < lineEnd && !isSpace(*p))
+			{
+				p++;
+			}
+			string name(keyword, p);
+
+			if (name == "newmtl")
+			{
+				current = &maps[restOfLine(p, lineEnd)];
+			}
+			else if (current && name == "map_Kd")
+			{
+				current->first = mapFile(p, lineEnd);
+			}
+			else if (current && name == "map_Ks")
+			{
+				current->second = mapFile(p, lineEnd);
+			}
+
+			p = lineEnd + 1;
+		}
+
+		for (map<string, pair<string, string> >::const_iterator it = maps.begin(); it != maps.end(); ++it)
+		{
+			vector<TextureRef> &textures = materials[it->first];
+			textures.clear();
+			if (!it->second.first.empty())
+			{
+				TextureRef ref = { "texture_diffuse", it->second.first };
+				textures.push_back(ref);
+			}
+			if (!it->second.second.empty())
+			{
+				TextureRef ref = { "texture_specular", it->second.second };
+				textures.push_back(ref);
+			}
+		}
+	}
+
+	// File name of a map statement, skipping the options in front of it (-bm 0.5, -s 1 1 1, -clamp on...)
+	static string mapFile(const char *p, const char *end)
+	{
+		for (skipSpaces(p, end); p < end && *p == '-'; skipSpaces(p, end))
+		{
+			while (p < end && !isSpace(*p))
+			{
+				p++;
+			}
+			for (skipSpaces(p, end); p < end; skipSpaces(p, end))
+			{
+				const char *argument = p;
+				float number;
+				if (parseFloat(p, end, number) && (p >= end || isSpace(*p)))
+				{
+					continue;
+				}
+				p = argument;
+				while (p < end && !isSpace(*p))
+				{
+					p++;
+				}
+				string word(argument, p);
+				if (word != "on" && word != "off")
+				{
+					p = argument;
+					break;
+				}
+			}
+		}
+		return restOfLine(p, end);
+	}
+
+	static bool resolve(int64_t index, size_t base, size_t count, size_t &resolved)
+	{
+		int64_t global = index >= 0 ? index : static_cast<int64_t>(base) + index + CHUNK_RELATIVE;
+		resolved = static_cast<size_t>(global);
+		return global >= 0 && resolved < count;
+	}
+
+	static bool writeVertices(const Chunk &chunk, const vector<glm::vec3> &positions, const vector<glm::vec2> &texCoords,
+		const vector<glm::vec3> &normals, vector<MeshData> &meshes)
+	{
+		for (size_t s = 0; s < chunk.segments.size(); s++)
+		{
+			const Segment &segment = chunk.segments[s];
+			if (segment.cornerCount == 0)
+			{
+				continue;
+			}
+
+			MeshData &mesh = meshes[segment.mesh];
+			for (size_t i = 0; i < segment.cornerCount; i++)
+			{
+				const Corner &corner = chunk.corners[segment.firstCorner + i];
+				size_t at = segment.meshOffset + i;
+				Vertex &vertex = mesh.vertices[at];
+				size_t index;
+
+				if (!resolve(corner.position, chunk.positionBase, positions.size(), index))
+				{
+					return false;
+				}
+				vertex.Position = positions[index];
+
+				vertex.Normal = glm::vec3(0.0f);
+				if (corner.normal != ABSENT)
+				{
+					if (!resolve(corner.normal, chunk.normalBase, normals.size(), index))
+					{
+						return false;
+					}
+					vertex.Normal = normals[index];
+				}
+
+				vertex.TexCoords = glm::vec2(0.0f);
+				if (corner.texCoord != ABSENT)
+				{
+					if (!resolve(corner.texCoord, chunk.texCoordBase, texCoords.size(), index))
+					{
+						return false;
+					}
+					vertex.TexCoords = glm::vec2(texCoords[index].x, 1.0f - texCoords[index].y);
+				}
+
+				mesh.indices[at] = static_cast<GLuint>(at);
+			}
+		}
+		return true;
+	}
+};
@@ -1,10 +1,21 @@
-﻿#include <string>
+﻿// Cuenta las asignaciones de memoria de cada importación (ver AllocationCounter.h). Solo en Debug: reemplaza
+// los operadores new y delete globales, que la versión Release conserva.
+#ifdef _DEBUG
+#define ALLOCATION_COUNTER_IMPLEMENTATION
+#endif
+#include "AllocationCounter.h"
+#include <string>
 #include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h"
+#include "ModelLoader.h"
+#include "LazyModel.h"
+#include "HotReload.h"
+#include "UniformBlocks.h"
+#include "InstanceBatcher.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -26,6 +37,12 @@ GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
 bool showComputer = false; // Variable para controlar la visibilidad
 
+// Escala para el nivel de detalle: projection[1][1] * alto de la pantalla, se actualiza cada cuadro
+float lodScale = 1.0f;
+
+// Dibuja las instancias repetidas de un modelo con una sola llamada por malla (ver InstanceBatcher.h)
+bool instancing = true;
+
 // Variables para la animación
 float globalAnimationTime = -1.0f;
 bool animationPlaying = false;
@@ -41,7 +58,7 @@ struct Keyframe {
 
 // Estructura para componentes de la computadora
 struct ComputerComponent {
-    Model* model;
+    LazyModel* model; // Se carga la primera vez que se pide (tecla R o --prefetch-components)
     std::vector<Keyframe> keyframes;
     bool isAnimating;
     bool hasAnimated;
@@ -53,6 +70,7 @@ struct ComputerInstance {
     glm::vec3 position;
     float     rotationY;
     glm::vec3 scale;
+    std::vector<GLuint> lods = {}; // Nivel de detalle de cada componente en el cuadro anterior
 };
 
 std::vector<ComputerComponent> components;
@@ -191,7 +209,8 @@ std::vector<Keyframe> CreateRandomRotationKeyframes(
 void RenderComponent(Shader& shader,
     ComputerComponent& component,
     float currentTime,
-    const glm::mat4& parentTransform)
+    const glm::mat4& parentTransform,
+    GLuint& lod)
 {
     Keyframe cf = GetCurrentKeyframe(component, currentTime);
 
@@ -202,38 +221,21 @@ void RenderComponent(Shader& shader,
 
     // Matriz final
     glm::mat4 modelMatrix = parentTransform * localM;
-    glUniformMatrix4fv(
-        glGetUniformLocation(shader.Program, "model"),
-        1, GL_FALSE, glm::value_ptr(modelMatrix)
-    );
+    shader.set("model", modelMatrix);
 
-    // Animación de color para resaltar el componente activo
+    // Avance de la animación del componente
     float progress = glm::clamp(
         (currentTime - component.animationStartTime) / component.animationDuration,
         0.0f, 1.0f
     );
 
-    if (component.isAnimating) {
-        // Color que cambia durante la animación
-        glm::vec3 animColor(
-            0.5f + 0.5f * sin(progress * 3.1416f),
-            0.5f - 0.5f * cos(progress * 3.1416f),
-            0.7f
-        );
-        glUniform3f(
-            glGetUniformLocation(shader.Program, "material.diffuse"),
-            animColor.r, animColor.g, animColor.b
-        );
-    }
-
-    component.model->Draw(shader);
-
-    // Restaurar color original
-    if (component.isAnimating) {
-        glUniform3f(
-            glGetUniformLocation(shader.Program, "material.diffuse"),
-            1.0f, 1.0f, 1.0f
-        );
+    // Mientras el modelo se carga en segundo plano no se dibuja
+    Model* model = component.model->Get();
+    if (model) {
+        float screenSize = model->ScreenSize(modelMatrix, camera.GetPosition(), lodScale);
+        lod = model->SelectLod(screenSize, lod);
+        model->StreamTextures(screenSize);
+        model->Draw(shader, lod, modelMatrix);
     }
 
     // Marcar como completado cuando termine
@@ -245,12 +247,14 @@ void RenderComponent(Shader& shader,
 
 void RenderComputer(Shader& shader,
     float currentTime,
-    const glm::mat4& parentTransform)
+    const glm::mat4& parentTransform,
+    std::vector<GLuint>& lods)
 {
     if (!showComputer && !animationPlaying) return; // No renderizar si no se debe mostrar
 
-    for (auto& comp : components) {
-        RenderComponent(shader, comp, currentTime, parentTransform);
+    lods.resize(components.size(), 0);
+    for (size_t i = 0; i < components.size(); ++i) {
+        RenderComponent(shader, components[i], currentTime, parentTransform, lods[i]);
     }
 }
 
@@ -259,6 +263,7 @@ struct ModelInstance {
     glm::vec3 position;
     float rotationY;
     glm::vec3 scale;
+    GLuint lod = 0; // Nivel de detalle del cuadro anterior (para la histéresis)
 };
 struct Workstation {
     ModelInstance desk;
@@ -268,21 +273,92 @@ struct Workstation {
     ModelInstance chair2;
 };
 
-// Función para renderizar una instancia
-void RenderInstance(Shader& shader, Model& model, const ModelInstance& ins) {
+// Matriz de modelo de una instancia
+glm::mat4 InstanceMatrix(const ModelInstance& ins) {
     glm::mat4 M(1.0f);
     M = glm::rotate(M, glm::radians(ins.rotationY), glm::vec3(0.0f, 1.0f, 0.0f));
     M = glm::translate(M, ins.position);
     M = glm::scale(M, ins.scale);
-    glUniformMatrix4fv(
-        glGetUniformLocation(shader.Program, "model"),
-        1, GL_FALSE, glm::value_ptr(M)
-    );
-    model.Draw(shader);
+    return M;
+}
+
+// Función para renderizar una instancia con el nivel de detalle según su tamaño en pantalla
+void RenderInstance(Shader& shader, Model& model, ModelInstance& ins) {
+    glm::mat4 M = InstanceMatrix(ins);
+    shader.set("model", M);
+    float screenSize = model.ScreenSize(M, camera.GetPosition(), lodScale);
+    ins.lod = model.SelectLod(screenSize, ins.lod);
+    model.StreamTextures(screenSize);
+    model.Draw(shader, ins.lod, M);
+}
+
+// Igual, pero con instancing solo la agrega al lote de su modelo y nivel de detalle; InstanceBatcher::Flush la dibuja.
+// Las instancias fuera de la vista se descartan aquí, el lote no recorta meshlets.
+void SubmitInstance(Shader& shader, Model& model, ModelInstance& ins) {
+    if (!instancing) {
+        RenderInstance(shader, model, ins);
+        return;
+    }
+    glm::mat4 M = InstanceMatrix(ins);
+    if (!model.Visible(M)) {
+        return;
+    }
+    float screenSize = model.ScreenSize(M, camera.GetPosition(), lodScale);
+    ins.lod = model.SelectLod(screenSize, ins.lod);
+    model.StreamTextures(screenSize);
+    InstanceBatcher::Instance().Add(model, ins.lod, M);
 }
 
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --float-vertices: vértices de 32 bytes en lugar del formato compacto, para comparar
+    // --cull-backfaces: activa GL_CULL_FACE, y con él el descarte de meshlets que miran hacia atrás
+    // --uncompressed-textures: texturas RGB en lugar de DXT1, para comparar la memoria que usan
+    // --texture-budget <MB>: memoria de video para las texturas antes de descartar sus mips más finos
+    // --loose-files: lee los archivos sueltos de Models/Proyecto aunque exista Models/Proyecto.pak
+    // --hot-reload: recarga los modelos, texturas y shaders cuyos archivos cambian en Models/ y Shader/ (implica --loose-files)
+    // --assimp-obj: importa los .obj con ASSIMP en lugar de ObjParser, para comparar
+    // --keep-geometry: conserva en memoria los vértices e índices de los modelos después de subirlos a la GPU
+    // --prefetch-components: empieza a cargar los componentes de la computadora al iniciar, sin esperar a la tecla R
+    // --no-instancing: dibuja los puestos de trabajo instancia por instancia, para comparar
+    bool cullBackfaces = false;
+    bool looseFiles = false;
+    bool hotReload = false;
+    bool prefetchComponents = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--float-vertices") {
+            Mesh::DefaultFormat() = VERTEX_FORMAT_FLOAT;
+        }
+        else if (std::string(argv[i]) == "--cull-backfaces") {
+            cullBackfaces = true;
+        }
+        else if (std::string(argv[i]) == "--uncompressed-textures") {
+            TextureCache::DefaultFormat() = TEXTURE_FORMAT_RGB;
+        }
+        else if (std::string(argv[i]) == "--texture-budget" && i + 1 < argc) {
+            TextureLoader::StreamingBudget() = size_t(atoi(argv[++i])) * 1024 * 1024;
+        }
+        else if (std::string(argv[i]) == "--loose-files") {
+            looseFiles = true;
+        }
+        else if (std::string(argv[i]) == "--hot-reload") {
+            hotReload = true;
+            looseFiles = true;
+        }
+        else if (std::string(argv[i]) == "--assimp-obj") {
+            Model::ObjParserEnabled() = false;
+        }
+        else if (std::string(argv[i]) == "--keep-geometry") {
+            Model::DefaultResidency() = GEOMETRY_KEEP_CPU;
+        }
+        else if (std::string(argv[i]) == "--prefetch-components") {
+            prefetchComponents = true;
+        }
+        else if (std::string(argv[i]) == "--no-instancing") {
+            instancing = false;
+        }
+    }
+
     // Inicialización de GLFW/GLEW y ventana
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -310,33 +386,81 @@ int main() {
 
     glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
     glEnable(GL_DEPTH_TEST);
+    if (cullBackfaces) {
+        glEnable(GL_CULL_FACE);
+    }
 
     Shader shader("Shader/lighting.vs", "Shader/lighting.frag");
     Shader shadowShader("Shader/shadow.vs", "Shader/shadow.frag");
+    // Misma iluminación, con la matriz de modelo por instancia
+    Shader instancedShader("Shader/lighting_instanced.vs", "Shader/lighting.frag");
+    // Los samplers apuntan una sola vez a las unidades de los materiales (ver Material.h)
+    MaterialRegistry::SetSamplers(shader);
+    MaterialRegistry::SetSamplers(instancedShader);
+    // Cámara y luces llegan en uniform blocks compartidos por todos los programas
+    FrameUniforms::BindBlocks(shader);
+    FrameUniforms::BindBlocks(shadowShader);
+    FrameUniforms::BindBlocks(instancedShader);
+
+    // Cargar modelos de la escena en paralelo (con caché binaria en disco, ver MeshCache.h)
+    double loadStart = glfwGetTime();
+    // Con el paquete que arma AssetCooker --pack, cada archivo es una búsqueda en su índice en lugar de abrirlo del disco
+    if (!looseFiles) {
+        AssetPack::Instance().Mount("Models/Proyecto");
+    }
+    Model piso, pared, techoo, lampara, pizarron, cpu, silla, mesa, ventanas;
+
+    // Componentes de computadora (animables): solo se cargan cuando se piden, casi nunca se ven
+    LazyModel gabinete("Models/Proyecto/gabinete/gabinete.obj");
+    LazyModel placamadre("Models/Proyecto/placamadre/placamadre.obj");
+    LazyModel procesador("Models/Proyecto/procesador/procesador.obj");
+    LazyModel ram("Models/Proyecto/ram/ram.obj");
+    LazyModel ssd("Models/Proyecto/ssd/ssd.obj");
+    LazyModel tarjetagrafica("Models/Proyecto/tarjetagrafica/tarjetagrafica.obj");
+    LazyModel ventilador("Models/Proyecto/ventilador/ventilador.obj");
+    LazyModel ventilador2("Models/Proyecto/ventilador2/ventilador.obj");
+    LazyModel fuente("Models/Proyecto/fuente/fuente.obj");
+    LazyModel monitor("Models/Proyecto/monitor/monitor.obj");
+    LazyModel teclado("Models/Proyecto/teclado/teclado.obj");
+
+    ModelLoader loader;
+    loader.Add(piso, "Models/Proyecto/piso/piso.obj");
+    loader.Add(pared, "Models/Proyecto/Pared/pared.obj");
+    loader.Add(techoo, "Models/Proyecto/piso1/piso.obj");
+    loader.Add(lampara, "Models/Proyecto/lampled/lampled.obj");
+    loader.Add(pizarron, "Models/Proyecto/pizarron/pizarron.obj");
+    loader.Add(cpu, "Models/Proyecto/computadora/computadora.obj");
+    loader.Add(silla, "Models/Proyecto/silla/silla.obj");
+    loader.Add(mesa, "Models/Proyecto/mesa/mesa.obj");
+    loader.Add(ventanas, "Models/Proyecto/ventana/ventana.obj");
+    loader.Run();
+    std::cout << "Modelos cargados en " << (glfwGetTime() - loadStart) * 1000.0 << " ms\n";
+    MeshRegistry::Instance().Report();
+
+    Model* sceneModels[] = { &piso, &pared, &techoo, &lampara, &pizarron, &cpu, &silla, &mesa, &ventanas };
+    LazyModel* componentModels[] = { &gabinete, &placamadre, &procesador, &ram, &ssd, &tarjetagrafica, &ventilador, &ventilador2,
+        &fuente, &monitor, &teclado };
+    if (prefetchComponents) {
+        for (LazyModel* model : componentModels) {
+            model->Prefetch();
+        }
+    }
 
-    // Cargar modelos de la escena
-    Model piso((char*)"Models/Proyecto/piso/piso.obj");
-    Model pared((char*)"Models/Proyecto/Pared/pared.obj");
-    Model techoo((char*)"Models/Proyecto/piso1/piso.obj");
-    Model lampara((char*)"Models/Proyecto/lampled/lampled.obj");
-    Model pizarron((char*)"Models/Proyecto/pizarron/pizarron.obj");
-    Model cpu((char*)"Models/Proyecto/computadora/computadora.obj");
-    Model silla((char*)"Models/Proyecto/silla/silla.obj");
-    Model mesa((char*)"Models/Proyecto/mesa/mesa.obj");
-    Model ventanas((char*)"Models/Proyecto/ventana/ventana.obj");
-
-    // Cargar componentes de computadora (animables)
-    Model gabinete((char*)"Models/Proyecto/gabinete/gabinete.obj");
-    Model placamadre((char*)"Models/Proyecto/placamadre/placamadre.obj");
-    Model procesador((char*)"Models/Proyecto/procesador/procesador.obj");
-    Model ram((char*)"Models/Proyecto/ram/ram.obj");
-    Model ssd((char*)"Models/Proyecto/ssd/ssd.obj");
-    Model tarjetagrafica((char*)"Models/Proyecto/tarjetagrafica/tarjetagrafica.obj");
-    Model ventilador((char*)"Models/Proyecto/ventilador/ventilador.obj");
-    Model ventilador2((char*)"Models/Proyecto/ventilador2/ventilador.obj");
-    Model fuente((char*)"Models/Proyecto/fuente/fuente.obj");
-    Model monitor((char*)"Models/Proyecto/monitor/monitor.obj");
-    Model teclado((char*)"Models/Proyecto/teclado/teclado.obj");
+    // Recarga en caliente: solo se vuelve a cargar lo que cambió, entre un cuadro y el siguiente
+    HotReload reloader;
+    if (hotReload) {
+        for (Model* model : sceneModels) {
+            reloader.WatchModel(*model);
+        }
+        for (LazyModel* model : componentModels) {
+            reloader.WatchModel(*model);
+        }
+        reloader.WatchShader(shader, "Shader/lighting.vs", "Shader/lighting.frag");
+        reloader.WatchShader(shadowShader, "Shader/shadow.vs", "Shader/shadow.frag");
+        reloader.WatchShader(instancedShader, "Shader/lighting_instanced.vs", "Shader/lighting.frag");
+        reloader.Start("Models");
+        reloader.Start("Shader");
+    }
 
     // Configurar puestos de trabajo
     std::vector<Workstation> workstations = {
@@ -558,7 +682,74 @@ int main() {
         glm::vec3(1.0f, 17.0f, -82.3f)),
         glm::vec3(63.0f, 30.0f, 3.0f));
 
+    // Definición de instancias de computadoras
+    std::vector<ComputerInstance> computerInstances = {
+        // fila 1 (izquierda):
+        { glm::vec3(-24.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-18.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-12.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-6.0f,  9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 2 (izquierda:
+        { glm::vec3(-24.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-18.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-12.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-6.0f,  9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 3 (izquierda:
+        { glm::vec3(-24.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-18.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-12.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-6.0f,  9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 4 (izquierda:
+        { glm::vec3(-24.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-18.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-12.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-6.0f,  9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 5 (izquierda:
+        { glm::vec3(-24.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-18.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-12.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(-6.0f,  9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 1 (derecha):
+        { glm::vec3(16.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(22.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(28.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(34.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 2 (derecha):
+        { glm::vec3(16.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(22.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(28.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(34.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 3 (derecha):
+        { glm::vec3(16.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(22.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(28.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(34.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 4 (derecha):
+        { glm::vec3(16.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(22.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(28.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(34.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
+
+        // fila 5 (derecha):
+        { glm::vec3(16.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(22.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(28.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+        { glm::vec3(34.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
+
+    };
+
     // Bucle principal
+    bool texturesReported = false;
+    bool computerRequested = false; // Se presionó R y los componentes aún se están cargando
+    bool componentsReported = false;
     while (!glfwWindowShouldClose(window)) {
 
         GLfloat currentFrame = static_cast<GLfloat>(glfwGetTime());
@@ -567,6 +758,25 @@ int main() {
 
         if (keys[GLFW_KEY_R]) {
             if (!animationPlaying) {
+                // La primera vez empieza a cargar los componentes; la animación arranca cuando están todos
+                for (LazyModel* model : componentModels) {
+                    model->Prefetch();
+                }
+                computerRequested = true;
+            }
+            keys[GLFW_KEY_R] = false;
+        }
+        if (computerRequested) {
+            bool componentsReady = true;
+            for (LazyModel* model : componentModels) {
+                componentsReady = model->Get() != nullptr && componentsReady;
+            }
+            if (componentsReady) {
+                computerRequested = false;
+                if (!componentsReported) {
+                    MeshRegistry::Instance().Report(); // Los ventiladores comparten su geometría
+                    componentsReported = true;
+                }
                 showComputer = true; // Hacer visible la computadora
                 globalAnimationTime = -1.0f;
                 animationPlaying = true;
@@ -576,7 +786,22 @@ int main() {
                     comp.hasAnimated = false;
                 }
             }
-            keys[GLFW_KEY_R] = false;
+        }
+
+        // Cambios en disco: los modelos recargados se intercambian aquí y las texturas las sube el TextureLoader
+        if (hotReload) {
+            reloader.Update();
+        }
+
+        // Subir las texturas que ya terminaron de decodificarse (mientras tanto se usa un placeholder)
+        TextureLoader::Instance().Update();
+        TextureRegistry::Instance().Collect();
+        if (!texturesReported && TextureLoader::Instance().Pending() == 0) {
+            TextureRegistry::Instance().Report();
+            for (Model* model : sceneModels) {
+                model->ReportMemory();
+            }
+            texturesReported = true;
         }
 
         // Actualizar animaciones
@@ -591,181 +816,97 @@ int main() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         shader.Use();
+        // Los datos por cuadro van al siguiente tramo del buffer circular de uniform blocks (ver UniformBlocks.h)
+        FrameUniforms::Instance().BeginFrame();
 
         // Configurar luces
+        LightsBlock lights;
+        memset(&lights, 0, sizeof(lights));
         // Luz direccional
-        glUniform3f(glGetUniformLocation(shader.Program, "dirLight.direction"),
-            -0.2f, -1.0f, -0.3f);
-        glUniform3f(glGetUniformLocation(shader.Program, "dirLight.ambient"),
-            0.5f, 0.5f, 0.5f);
-        glUniform3f(glGetUniformLocation(shader.Program, "dirLight.diffuse"),
-            0.8f, 0.8f, 0.8f);
-        glUniform3f(glGetUniformLocation(shader.Program, "dirLight.specular"),
-            0.5f, 0.5f, 0.5f);
+        lights.dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+        lights.dirLight.ambient = glm::vec3(0.5f, 0.5f, 0.5f);
+        lights.dirLight.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        lights.dirLight.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+        // Espacio de recorte de la luz direccional, para la pasada de sombras
+        lights.lightSpaceMatrix = glm::ortho(-30.0f, 30.0f, -30.0f, 30.0f, 1.0f, 80.0f)
+            * glm::lookAt(-40.0f * glm::normalize(lights.dirLight.direction), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
         // Luz puntual (lámpara)
         glm::vec3 lightPos(0.4f, 20.0f, -10.5f);
-        glUniform3f(glGetUniformLocation(shader.Program,
-            "pointLights[0].position"),
-            lightPos.x, lightPos.y, lightPos.z);
-        glUniform3f(glGetUniformLocation(shader.Program,
-            "pointLights[0].ambient"),
-            0.2f, 0.2f, 0.2f);
-        glUniform3f(glGetUniformLocation(shader.Program,
-            "pointLights[0].diffuse"),
-            0.8f, 0.8f, 0.8f);
-        glUniform3f(glGetUniformLocation(shader.Program,
-            "pointLights[0].specular"),
-            1.0f, 1.0f, 1.0f);
-        glUniform1f(glGetUniformLocation(shader.Program,
-            "pointLights[0].constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(shader.Program,
-            "pointLights[0].linear"), 0.09f);
-        glUniform1f(glGetUniformLocation(shader.Program,
-            "pointLights[0].quadratic"), 0.032f);
+        lights.pointLights[0].position = lightPos;
+        lights.pointLights[0].ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+        lights.pointLights[0].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        lights.pointLights[0].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        lights.pointLights[0].constant = 1.0f;
+        lights.pointLights[0].linear = 0.09f;
+        lights.pointLights[0].quadratic = 0.032f;
 
         // Spotlight (cámara)
-        glUniform3f(glGetUniformLocation(shader.Program, "spotLight.position"),
-            camera.GetPosition().x, camera.GetPosition().y,
-            camera.GetPosition().z);
-        glUniform3f(glGetUniformLocation(shader.Program, "spotLight.direction"),
-            camera.GetFront().x, camera.GetFront().y,
-            camera.GetFront().z);
-        glUniform3f(glGetUniformLocation(shader.Program, "spotLight.ambient"),
-            0.1f, 0.1f, 0.1f);
-        glUniform3f(glGetUniformLocation(shader.Program, "spotLight.diffuse"),
-            0.8f, 0.8f, 0.8f);
-        glUniform3f(glGetUniformLocation(shader.Program, "spotLight.specular"),
-            1.0f, 1.0f, 1.0f);
-        glUniform1f(glGetUniformLocation(shader.Program, "spotLight.constant"), 1.0f);
-        glUniform1f(glGetUniformLocation(shader.Program, "spotLight.linear"), 0.09f);
-        glUniform1f(glGetUniformLocation(shader.Program, "spotLight.quadratic"), 0.032f);
-        glUniform1f(glGetUniformLocation(shader.Program, "spotLight.cutOff"),
-            glm::cos(glm::radians(12.5f)));
-        glUniform1f(glGetUniformLocation(shader.Program, "spotLight.outerCutOff"),
-            glm::cos(glm::radians(15.0f)));
+        lights.spotLight.position = camera.GetPosition();
+        lights.spotLight.direction = camera.GetFront();
+        lights.spotLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+        lights.spotLight.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        lights.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        lights.spotLight.constant = 1.0f;
+        lights.spotLight.linear = 0.09f;
+        lights.spotLight.quadratic = 0.032f;
+        lights.spotLight.cutOff = glm::cos(glm::radians(12.5f));
+        lights.spotLight.outerCutOff = glm::cos(glm::radians(15.0f));
+        FrameUniforms::Instance().SetLights(lights);
 
         // Material
-        glUniform3f(glGetUniformLocation(shader.Program, "material.specular"),
-            0.5f, 0.5f, 0.5f);
-        glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"),
-            32.0f);
+        shader.set("material.shininess", 32.0f);
 
         // Vista y proyección
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(camera.GetZoom(),
+        CameraBlock cameraBlock;
+        memset(&cameraBlock, 0, sizeof(cameraBlock));
+        cameraBlock.view = camera.GetViewMatrix();
+        cameraBlock.projection = glm::perspective(camera.GetZoom(),
             (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT,
             0.1f, 100.0f);
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "projection"),
-            1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "view"),
-            1, GL_FALSE, glm::value_ptr(view));
-        glUniform3f(glGetUniformLocation(shader.Program, "viewPos"),
-            camera.GetPosition().x,
-            camera.GetPosition().y,
-            camera.GetPosition().z);
+        cameraBlock.viewPos = camera.GetPosition();
+        FrameUniforms::Instance().SetCamera(cameraBlock);
+        lodScale = cameraBlock.projection[1][1] * SCREEN_HEIGHT;
+        ClusterCulling::Instance().BeginFrame(cameraBlock.projection * cameraBlock.view, camera.GetPosition());
 
         // Renderizar ventanas
-        for (const auto& wi : windows) {
+        for (auto& wi : windows) {
             RenderInstance(shader, ventanas, wi);
         }
 
         // Lámpara
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(lampTransform));
-        lampara.Draw(shader);
+        shader.set("model", lampTransform);
+        lampara.StreamTextures(lampara.ScreenSize(lampTransform, camera.GetPosition(), lodScale));
+        lampara.Draw(shader, 0, lampTransform);
 
         // Techo
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(ceilingTransform));
-        techoo.Draw(shader);
+        shader.set("model", ceilingTransform);
+        techoo.StreamTextures(techoo.ScreenSize(ceilingTransform, camera.GetPosition(), lodScale));
+        techoo.Draw(shader, 0, ceilingTransform);
 
         // Piso
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(floorTransform));
-        piso.Draw(shader);
+        shader.set("model", floorTransform);
+        piso.StreamTextures(piso.ScreenSize(floorTransform, camera.GetPosition(), lodScale));
+        piso.Draw(shader, 0, floorTransform);
 
         // Paredes
-        for (const auto& w : walls) {
+        for (auto& w : walls) {
             RenderInstance(shader, pared, w);
         }
 
         // Pared frontal
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(frontWallTransform));
-        pared.Draw(shader);
+        shader.set("model", frontWallTransform);
+        pared.StreamTextures(pared.ScreenSize(frontWallTransform, camera.GetPosition(), lodScale));
+        pared.Draw(shader, 0, frontWallTransform);
 
         // Pizarrón
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(boardTransform));
-        pizarron.Draw(shader);
-
-        // Definición de instancias de computadoras
-        std::vector<ComputerInstance> computerInstances = {
-            // fila 1 (izquierda):
-            { glm::vec3(-24.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-18.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-12.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-6.0f,  9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 2 (izquierda:
-            { glm::vec3(-24.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-18.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-12.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-6.0f,  9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 3 (izquierda:
-            { glm::vec3(-24.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-18.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-12.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-6.0f,  9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 4 (izquierda:
-            { glm::vec3(-24.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-18.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-12.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-6.0f,  9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 5 (izquierda:
-            { glm::vec3(-24.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-18.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-12.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(-6.0f,  9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 1 (derecha):
-            { glm::vec3(16.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(22.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(28.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(34.0f, 9.0f, 25.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 2 (derecha):
-            { glm::vec3(16.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(22.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(28.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(34.0f, 9.0f, 10.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 3 (derecha):
-            { glm::vec3(16.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(22.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(28.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(34.0f, 9.0f, -5.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 4 (derecha):
-            { glm::vec3(16.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(22.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(28.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(34.0f, 9.0f, -20.0f), 180.0f, glm::vec3(3.0f) },
-
-            // fila 5 (derecha):
-            { glm::vec3(16.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(22.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(28.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-            { glm::vec3(34.0f, 9.0f, -35.0f), 180.0f, glm::vec3(3.0f) },
-
-        };
+        shader.set("model", boardTransform);
+        pizarron.StreamTextures(pizarron.ScreenSize(boardTransform, camera.GetPosition(), lodScale));
+        pizarron.Draw(shader, 0, boardTransform);
+
 
         //RenderComputer(shader, globalAnimationTime);
-        for (const auto& ci : computerInstances) {
+        for (auto& ci : computerInstances) {
             // 1) monta la matriz padre para ESTA instancia
             glm::mat4 compModel = glm::mat4(1.0f);
             compModel = glm::translate(compModel, ci.position);
@@ -775,31 +916,33 @@ int main() {
             compModel = glm::scale(compModel, ci.scale);
 
             // 2) dibuja todos los componentes bajo esa transformación
-            RenderComputer(shader, globalAnimationTime, compModel);
+            RenderComputer(shader, globalAnimationTime, compModel, ci.lods);
         }
 
 
         // Mesas (madera, medio brillo)
-        glUniform3f(glGetUniformLocation(shader.Program, "dirLight.ambient"),
-            0.3f, 0.3f, 0.3f);
-        glUniform3f(glGetUniformLocation(shader.Program, "dirLight.diffuse"),
-            0.9f, 0.9f, 0.9f);
-        glUniform3f(glGetUniformLocation(shader.Program, "material.specular"),
-            0.2f, 0.2f, 0.2f);
-        glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"),
-            30.0f);
-
-        // Render puestos de trabajo
-        for (const auto& ws : workstations) {
-            RenderInstance(shader, mesa, ws.desk);
-            RenderInstance(shader, cpu, ws.cpu1);
-            RenderInstance(shader, cpu, ws.cpu2);
-            RenderInstance(shader, silla, ws.chair1);
-            RenderInstance(shader, silla, ws.chair2);
+        // Otro tramo del buffer: los dibujos ya emitidos siguen leyendo el anterior
+        lights.dirLight.ambient = glm::vec3(0.3f, 0.3f, 0.3f);
+        lights.dirLight.diffuse = glm::vec3(0.9f, 0.9f, 0.9f);
+        FrameUniforms::Instance().SetLights(lights);
+        Shader& deskShader = instancing ? instancedShader : shader;
+        deskShader.Use();
+        deskShader.set("material.shininess", 30.0f);
+
+        // Render puestos de trabajo: con instancing, una llamada por malla de cada modelo para todos los puestos
+        for (auto& ws : workstations) {
+            SubmitInstance(deskShader, mesa, ws.desk);
+            SubmitInstance(deskShader, cpu, ws.cpu1);
+            SubmitInstance(deskShader, cpu, ws.cpu2);
+            SubmitInstance(deskShader, silla, ws.chair1);
+            SubmitInstance(deskShader, silla, ws.chair2);
         }
-        RenderInstance(shader, mesa, teacherDesk);
-        RenderInstance(shader, mesa, additionalDesk);
+        SubmitInstance(deskShader, mesa, teacherDesk);
+        SubmitInstance(deskShader, mesa, additionalDesk);
+        InstanceBatcher::Instance().Flush(deskShader);
 
+        FrameUniforms::Instance().EndFrame();
+        RenderStats::Instance().EndFrame(glfwGetTime());
         glfwSwapBuffers(window);
     }
 
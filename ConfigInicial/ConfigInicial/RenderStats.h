@@ -0,0 +1,114 @@
+#pragma once
+
+#include <sstream>
+#include <iostream>
+#include <cstddef>
+
+#include <GL/glew.h>
+
+using namespace std;
+
+// Seconds between two printed reports
+const double RENDER_STATS_INTERVAL = 5.0;
+
+// Per-frame renderer counters. The renderer increments them while drawing and EndFrame()
+// prints their averages every RENDER_STATS_INTERVAL seconds.
+class RenderStats
+{
+public:
+	/*  Counters of the current frame  */
+	GLuint drawCalls;
+	size_t triangles;
+	size_t fullDetailTriangles;		// What the same draws would have cost at LOD0
+	size_t culledTriangles;			// Skipped by meshlet culling
+	GLuint textureBinds;			// glBindTexture calls issued...
+	GLuint textureBindRequests;		// ...out of the bindings draws asked for (see TextureBindings)
+	GLuint uniformUploads;			// glUniform* calls issued...
+	GLuint uniformRequests;			// ...out of the values set through Shader::set
+	GLuint uniformBlockWrites;		// Blocks written to the uniform ring (see FrameUniforms)
+
+	static RenderStats &Instance()
+	{
+		static RenderStats stats;
+		return stats;
+	}
+
+	// Closes the current frame, now being the time in seconds (glfwGetTime)
+	void EndFrame(double now)
+	{
+		if (this->intervalStart < 0.0)
+		{
+			this->intervalStart = now;
+		}
+
+		this->frames++;
+		this->sumDrawCalls += this->drawCalls;
+		this->sumTriangles += this->triangles;
+		this->sumFullDetailTriangles += this->fullDetailTriangles;
+		this->sumCulledTriangles += this->culledTriangles;
+		this->sumTextureBinds += this->textureBinds;
+		this->sumTextureBindRequests += this->textureBindRequests;
+		this->sumUniformUploads += this->uniformUploads;
+		this->sumUniformRequests += this->uniformRequests;
+		this->sumUniformBlockWrites += this->uniformBlockWrites;
+		this->drawCalls = 0;
+		this->triangles = 0;
+		this->fullDetailTriangles = 0;
+		this->culledTriangles = 0;
+		this->textureBinds = 0;
+		this->textureBindRequests = 0;
+		this->uniformUploads = 0;
+		this->uniformRequests = 0;
+		this->uniformBlockWrites = 0;
+
+		double elapsed = now - this->intervalStart;
+		if (elapsed < RENDER_STATS_INTERVAL)
+		{
+			return;
+		}
+
+		ostringstream log;
+		log << "RENDER::STATS:: " << elapsed * 1000.0 / this->frames << " ms/frame, "
+			<< this->sumDrawCalls / this->frames << " draw calls, "
+			<< this->sumTriangles / this->frames << " triangles submitted (" << this->sumCulledTriangles / this->frames << " culled by meshlet, "
+			<< this->sumFullDetailTriangles / this->frames << " at full detail), "
+			// Without the bindings cache every requested bind was issued and undone after the draw
+			<< this->sumTextureBinds / this->frames << " texture binds (" << 2 * this->sumTextureBindRequests / this->frames << " without caching), "
+			// Without the uniform cache every value set was a glGetUniformLocation and a glUniform*
+			<< this->sumUniformUploads / this->frames << " uniform uploads (" << 2 * this->sumUniformRequests / this->frames << " driver calls without caching), "
+			<< this->sumUniformBlockWrites / this->frames << " uniform block writes" << endl;
+		cout << log.str();
+
+		this->intervalStart = now;
+		this->frames = 0;
+		this->sumDrawCalls = 0;
+		this->sumTriangles = 0;
+		this->sumFullDetailTriangles = 0;
+		this->sumCulledTriangles = 0;
+		this->sumTextureBinds = 0;
+		this->sumTextureBindRequests = 0;
+		this->sumUniformUploads = 0;
+		this->sumUniformRequests = 0;
+		this->sumUniformBlockWrites = 0;
+	}
+
+private:
+	double intervalStart;
+	GLuint frames;
+	size_t sumDrawCalls;
+	size_t sumTriangles;
+	size_t sumFullDetailTriangles;
+	size_t sumCulledTriangles;
+	size_t sumTextureBinds;
+	size_t sumTextureBindRequests;
+	size_t sumUniformUploads;
+	size_t sumUniformRequests;
+	size_t sumUniformBlockWrites;
+
+	RenderStats() : drawCalls(0), triangles(0), fullDetailTriangles(0), culledTriangles(0), textureBinds(0), textureBindRequests(0),
+		uniformUploads(0), uniformRequests(0), uniformBlockWrites(0), intervalStart(-1.0), frames(0), sumDrawCalls(0), sumTriangles(0), sumFullDetailTriangles(0), sumCulledTriangles(0), sumTextureBinds(0),
+		sumTextureBindRequests(0), sumUniformUploads(0), sumUniformRequests(0),
+		sumUniformBlockWrites(0)
+	{
+	}
+};
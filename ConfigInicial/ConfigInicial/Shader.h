@@ -5,17 +5,259 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Hash.h"
+#include "RenderStats.h"
+
+// Index of an active uniform of a Shader, for its setters. -1 if the program has no such uniform.
+typedef GLint UniformID;
+
+// IDs of the uniforms every mesh draw sets (see Mesh::Draw), resolved once per (re)build
+struct MeshUniformIDs
+{
+	UniformID shininess;
+	UniformID quantized;
+	UniformID boundsMin;
+	UniformID boundsExtent;
+};
 
 class Shader
 {
 public:
 	GLuint Program;
 	GLuint uniformColor;
+	MeshUniformIDs meshUniforms;
 	// Constructor generates the shader on the fly
 	Shader(const GLchar *vertexPath, const GLchar *fragmentPath)
 	{
+		bool success;
+		this->Program = build(vertexPath, fragmentPath, success);
+		this->reflect();
+		//le damos la localidad de color
+		uniformColor = glGetUniformLocation(this->Program, "color");
+	}
+
+	// Rebuilds the program from the same kind of files, e.g. after they changed on disk. On a compile or link error
+	// the current program is kept and false is returned.
+	bool Reload(const GLchar *vertexPath, const GLchar *fragmentPath)
+	{
+		bool success;
+		GLuint program = build(vertexPath, fragmentPath, success);
+		if (!success)
+		{
+			glDeleteProgram(program);
+			return false;
+		}
+
+		glDeleteProgram(this->Program);
+		this->Program = program;
+		this->reflect();
+		uniformColor = glGetUniformLocation(this->Program, "color");
+		return true;
+	}
+
+	// Uses the current shader
+	void Use()
+	{
+		glUseProgram(this->Program);
+	}
+
+	GLuint getColorLocation()
+	{
+		return uniformColor;
+	}
+
+	// ID of an active uniform by the name GLSL gives it ("model", "pointLights[0].position"), found in the table
+	// built at link time instead of asking the driver
+	UniformID Uniform(const GLchar *name) const
+	{
+		std::unordered_map<uint64_t, UniformID>::const_iterator it = this->ids.find(Hash64(name, strlen(name)));
+		return it == this->ids.end() ? -1 : it->second;
+	}
+
+	// Typed setters, for the program in use. A value equal to the last one uploaded to the uniform is not sent again.
+	void set(UniformID id, GLint value)
+	{
+		if (this->changed(id, GL_INT, &value, sizeof(value)))
+		{
+			glUniform1i(this->uniforms[id].location, value);
+		}
+	}
+
+	void set(UniformID id, GLfloat value)
+	{
+		if (this->changed(id, GL_FLOAT, &value, sizeof(value)))
+		{
+			glUniform1f(this->uniforms[id].location, value);
+		}
+	}
+
+	void set(UniformID id, const glm::vec3 &value)
+	{
+		if (this->changed(id, GL_FLOAT_VEC3, glm::value_ptr(value), sizeof(value)))
+		{
+			glUniform3fv(this->uniforms[id].location, 1, glm::value_ptr(value));
+		}
+	}
+
+	void set(UniformID id, const glm::mat4 &value)
+	{
+		if (this->changed(id, GL_FLOAT_MAT4, glm::value_ptr(value), sizeof(value)))
+		{
+			glUniformMatrix4fv(this->uniforms[id].location, 1, GL_FALSE, glm::value_ptr(value));
+		}
+	}
+
+	template <typename T>
+	void set(const GLchar *name, const T &value)
+	{
+		this->set(this->Uniform(name), value);
+	}
+
+
+private:
+	struct ActiveUniform
+	{
+		std::string name;
+		GLint location;
+		GLenum type;
+		GLfloat value[16];			// Last value uploaded, the bytes of whichever type it has
+		bool uploaded;
+		bool mismatchReported;
+	};
+
+	std::vector<ActiveUniform> uniforms;
+	std::unordered_map<uint64_t, UniformID> ids;		// By Hash64 of the name
+
+	// Lists the active uniforms of the program, each element of an array of a basic type on its own. Their values
+	// start unknown, a (re)linked program has them all at zero.
+	void reflect()
+	{
+		this->uniforms.clear();
+		this->ids.clear();
+
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> buffer(maxLength + 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(this->Program, i, static_cast<GLsizei>(buffer.size()), &length, &size, &type, buffer.data());
+			std::string name(buffer.data(), length);
+
+			// Arrays of basic types come once, as "name[0]"
+			bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+			if (isArray)
+			{
+				name.resize(name.size() - 3);
+			}
+			for (GLint element = 0; element < size; element++)
+			{
+				std::string elementName = name;
+				if (isArray)
+				{
+					std::ostringstream index;
+					index << "[" << element << "]";
+					elementName += index.str();
+				}
+
+				// Members of uniform blocks have no location, they are not set one by one
+				GLint location = glGetUniformLocation(this->Program, elementName.c_str());
+				if (location < 0)
+				{
+					continue;
+				}
+
+				ActiveUniform uniform;
+				uniform.name = elementName;
+				uniform.location = location;
+				uniform.type = type;
+				uniform.uploaded = false;
+				uniform.mismatchReported = false;
+				UniformID id = static_cast<UniformID>(this->uniforms.size());
+				this->uniforms.push_back(uniform);
+				this->addName(elementName, id);
+				if (isArray && element == 0)
+				{
+					this->addName(name, id);
+				}
+			}
+		}
+
+		this->meshUniforms.shininess = this->Uniform("material.shininess");
+		this->meshUniforms.quantized = this->Uniform("quantized");
+		this->meshUniforms.boundsMin = this->Uniform("boundsMin");
+		this->meshUniforms.boundsExtent = this->Uniform("boundsExtent");
+	}
+
+	void addName(const std::string &name, UniformID id)
+	{
+		uint64_t hash = Hash64(name.data(), name.size());
+		if (this->ids.find(hash) != this->ids.end())
+		{
+			std::cout << "ERROR::SHADER::UNIFORM_NAME_COLLISION " << name << std::endl;
+			return;
+		}
+		this->ids[hash] = id;
+	}
+
+	// Whether a value has to be uploaded to the uniform: it exists, takes that type and holds something else.
+	// Remembers the value if so.
+	bool changed(UniformID id, GLenum type, const void *value, size_t bytes)
+	{
+		RenderStats::Instance().uniformRequests++;
+		if (id < 0)
+		{
+			return false;
+		}
+
+		ActiveUniform &uniform = this->uniforms[id];
+		if (!accepts(uniform.type, type))
+		{
+			if (!uniform.mismatchReported)
+			{
+				std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH " << uniform.name << std::endl;
+				uniform.mismatchReported = true;
+			}
+			return false;
+		}
+		if (uniform.uploaded && memcmp(uniform.value, value, bytes) == 0)
+		{
+			return false;
+		}
+
+		memcpy(uniform.value, value, bytes);
+		uniform.uploaded = true;
+		RenderStats::Instance().uniformUploads++;
+		return true;
+	}
+
+	// Whether a uniform of a GLSL type can be set with the setter of another. Booleans and samplers are set as ints.
+	static bool accepts(GLenum uniformType, GLenum setterType)
+	{
+		if (uniformType == setterType)
+		{
+			return true;
+		}
+		return setterType == GL_INT && (uniformType == GL_BOOL || uniformType == GL_SAMPLER_2D || uniformType == GL_SAMPLER_3D
+			|| uniformType == GL_SAMPLER_CUBE || uniformType == GL_SAMPLER_2D_SHADOW);
+	}
+
+	// Compiles and links a program, printing the errors if any. success tells whether every step went through.
+	static GLuint build(const GLchar *vertexPath, const GLchar *fragmentPath, bool &success)
+	{
+		success = true;
 		// 1. Retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
 		std::string fragmentCode;
@@ -43,21 +285,23 @@ public:
 		catch (std::ifstream::failure e)
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			success = false;
 		}
 		const GLchar *vShaderCode = vertexCode.c_str();
 		const GLchar *fShaderCode = fragmentCode.c_str();
 		// 2. Compile shaders
 		GLuint vertex, fragment;
-		GLint success;
+		GLint status;
 		GLchar infoLog[512];
 		// Vertex Shader
 		vertex = glCreateShader(GL_VERTEX_SHADER);
 		glShaderSource(vertex, 1, &vShaderCode, NULL);
 		glCompileShader(vertex);
 		// Print compile errors if any
-		glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-		if (!success)
+		glGetShaderiv(vertex, GL_COMPILE_STATUS, &status);
+		if (!status)
 		{
+			success = false;
 			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 		}
@@ -66,43 +310,32 @@ public:
 		glShaderSource(fragment, 1, &fShaderCode, NULL);
 		glCompileShader(fragment);
 		// Print compile errors if any
-		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-		if (!success)
+		glGetShaderiv(fragment, GL_COMPILE_STATUS, &status);
+		if (!status)
 		{
+			success = false;
 			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 		}
 		// Shader Program
-		this->Program = glCreateProgram();
-		glAttachShader(this->Program, vertex);
-		glAttachShader(this->Program, fragment);
-		glLinkProgram(this->Program);
+		GLuint program = glCreateProgram();
+		glAttachShader(program, vertex);
+		glAttachShader(program, fragment);
+		glLinkProgram(program);
 		// Print linking errors if any
-		glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
-		if (!success)
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (!status)
 		{
-			glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
+			success = false;
+			glGetProgramInfoLog(program, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
 		}
-		//le damos la localidad de color
-		uniformColor = glGetUniformLocation(this->Program, "color");
 		// Delete the shaders as they're linked into our program now and no longer necessery
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
 
+		return program;
 	}
-	// Uses the current shader
-	void Use()
-	{
-		glUseProgram(this->Program);
-	}
-
-	GLuint getColorLocation()
-	{
-		return uniformColor;
-	}
-
-
 };
 
 #endif
\ No newline at end of file
@@ -4,8 +4,14 @@ layout (location = 0) in vec3 position;
 
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// Per-frame camera, shared by every program (CameraBlock in UniformBlocks.h)
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
 
 void main()
 {
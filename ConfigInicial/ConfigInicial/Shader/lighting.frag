@@ -53,10 +53,22 @@ in vec2 TexCoords;
 
 out vec4 color;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NUMBER_OF_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// Per-frame camera and lights, shared by every program (CameraBlock and LightsBlock in UniformBlocks.h)
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    mat4 lightSpaceMatrix;
+    DirLight dirLight;
+    PointLight pointLights[NUMBER_OF_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
 uniform Material material;
 uniform int transparency;
 
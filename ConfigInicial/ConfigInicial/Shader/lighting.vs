@@ -8,13 +8,37 @@ out vec3 FragPos;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// Per-frame camera, shared by every program (CameraBlock in UniformBlocks.h)
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+// Packed vertices (PackedVertex in Mesh.h): position normalized inside the mesh bounds, octahedral normal in normal.xy
+uniform bool quantized;
+uniform vec3 boundsMin;
+uniform vec3 boundsExtent;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0.0f)
+    {
+        n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(n);
+}
 
 void main()
 {
-    gl_Position = projection * view *  model * vec4(position, 1.0f);
-    FragPos = vec3(model * vec4(position, 1.0f));
-    Normal = mat3(transpose(inverse(model))) * normal;
+    vec3 localPosition = quantized ? boundsMin + position * boundsExtent : position;
+    vec3 localNormal = quantized ? octDecode(normal.xy) : normal;
+
+    gl_Position = projection * view *  model * vec4(localPosition, 1.0f);
+    FragPos = vec3(model * vec4(localPosition, 1.0f));
+    Normal = mat3(transpose(inverse(model))) * localNormal;
     TexCoords = texCoords;
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texCoords;
+// Model matrix of the instance, one column per location (InstanceBuffer.h)
+layout (location = 3) in mat4 model;
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+
+// Per-frame camera, shared by every program (CameraBlock in UniformBlocks.h)
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+// Packed vertices, see lighting.vs
+uniform bool quantized;
+uniform vec3 boundsMin;
+uniform vec3 boundsExtent;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0.0f)
+    {
+        n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(n);
+}
+
+void main()
+{
+    vec3 localPosition = quantized ? boundsMin + position * boundsExtent : position;
+    vec3 localNormal = quantized ? octDecode(normal.xy) : normal;
+
+    gl_Position = projection * view *  model * vec4(localPosition, 1.0f);
+    FragPos = vec3(model * vec4(localPosition, 1.0f));
+    Normal = mat3(transpose(inverse(model))) * localNormal;
+    TexCoords = texCoords;
+}
\ No newline at end of file
@@ -4,9 +4,21 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 texCoords;
 
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
+
+// Per-frame lights (LightsBlock in UniformBlocks.h). The shadow pass only reads the first member, which is all
+// it declares.
+layout (std140) uniform Lights
+{
+    mat4 lightSpaceMatrix;
+};
+
+// Packed vertices, see lighting.vs
+uniform bool quantized;
+uniform vec3 boundsMin;
+uniform vec3 boundsExtent;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(position, 1.0);
+    vec3 localPosition = quantized ? boundsMin + position * boundsExtent : position;
+    gl_Position = lightSpaceMatrix * model * vec4(localPosition, 1.0);
 }
\ No newline at end of file
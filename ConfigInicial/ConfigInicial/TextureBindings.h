@@ -0,0 +1,64 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "RenderStats.h"
+
+// Texture units whose bindings are tracked
+const GLuint TEXTURE_BINDING_UNITS = 16;
+
+// The 2D texture bound to each unit, so consecutive draws that share textures do not bind them again and
+// nothing has to be unbound after a draw. Code binding textures behind its back must call Invalidate().
+class TextureBindings
+{
+public:
+	static TextureBindings &Instance()
+	{
+		static TextureBindings bindings;
+		return bindings;
+	}
+
+	// Binds a texture to a unit unless it is bound there already
+	void Bind(GLuint unit, GLuint textureID)
+	{
+		RenderStats &stats = RenderStats::Instance();
+		stats.textureBindRequests++;
+		if (unit < TEXTURE_BINDING_UNITS && this->bound[unit] == textureID)
+		{
+			return;
+		}
+
+		if (unit != this->activeUnit)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			this->activeUnit = unit;
+		}
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		if (unit < TEXTURE_BINDING_UNITS)
+		{
+			this->bound[unit] = textureID;
+		}
+		stats.textureBinds++;
+	}
+
+	// Forgets what is bound where, after textures were bound or deleted elsewhere
+	void Invalidate()
+	{
+		for (GLuint i = 0; i < TEXTURE_BINDING_UNITS; i++)
+		{
+			this->bound[i] = UNKNOWN;
+		}
+		this->activeUnit = UNKNOWN;
+	}
+
+private:
+	static const GLuint UNKNOWN = ~GLuint(0);
+
+	GLuint bound[TEXTURE_BINDING_UNITS];
+	GLuint activeUnit;
+
+	TextureBindings()
+	{
+		this->Invalidate();
+	}
+};
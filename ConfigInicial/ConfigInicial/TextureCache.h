@@ -0,0 +1,301 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+
+#include <GL/glew.h>
+
+#include "AssetPack.h"
+#include "TextureMips.h"
+#include "ThreadPool.h"
+extern "C"
+{
+#include "SOIL2/image_DXT.h"
+}
+
+using namespace std;
+
+// Bump whenever the layout of the cache file or the pixels it stores change
+const uint32_t TEXTURE_CACHE_VERSION = 3;
+// Texel rows of a level compressed by one task, a multiple of the 4-row block height
+const int DXT_BAND_ROWS = 64;
+// Tag in the reserved words of the DDS header marking a file as written by TextureCache
+const uint32_t TEXTURE_CACHE_TAG = 'T' | ('E' << 8) | ('X' << 16) | ('C' << 24);
+
+// How a texture is stored in its cache and on the GPU
+enum TextureFormat
+{
+	TEXTURE_FORMAT_RGB,		// RGB8, 3 bytes per texel
+	TEXTURE_FORMAT_DXT1		// BC1, 8 bytes per block of 4x4 texels: a sixth of RGB8
+};
+
+// One mip level inside the cache, offset from Data()
+struct TextureLevel
+{
+	int width;
+	int height;
+	size_t offset;
+	size_t size;
+};
+
+// On-disk, ready-to-upload copy of an image file, keyed by the source's size and modification time. The file is a
+// plain DDS (readable by any DDS tool) next to the source; the key lives in the reserved words of its header.
+// Every mip level is stored, built on the CPU (see TextureMips.h). Written by the asset cooker or on first load, a hit
+// is memory-mapped and uploaded level by level as is, skipping the decode and glGenerateMipmap.
+class TextureCache
+{
+public:
+	// Returns the path of the cache file that belongs to the given image file
+	static string CachePath(const string &sourcePath)
+	{
+		return sourcePath + ".dds";
+	}
+
+	// Format textures are cached and uploaded in from now on
+	static TextureFormat &DefaultFormat()
+	{
+		static TextureFormat format = TEXTURE_FORMAT_DXT1;
+		return format;
+	}
+
+	// Bytes of one level of the given size
+	static size_t LevelSize(TextureFormat format, int width, int height)
+	{
+		if (format == TEXTURE_FORMAT_DXT1)
+		{
+			return size_t((width + 3) / 4) * ((height + 3) / 4) * 8;
+		}
+		return size_t(width) * height * 3;
+	}
+
+	// Levels of a full mip chain, down to 1x1
+	static GLuint FullLevelCount(int width, int height)
+	{
+		GLuint count = 1;
+		while (width > 1 || height > 1)
+		{
+			width = max(1, width / 2);
+			height = max(1, height / 2);
+			count++;
+		}
+		return count;
+	}
+
+	// Maps the cache of the given image. Returns false on a miss (no cache, stale source, other format or version).
+	bool Open(const string &sourcePath, TextureFormat format)
+	{
+		this->Close();
+
+		FileStamp stamp;
+		if (!GetAssetStamp(sourcePath, stamp) || !this->file.Open(CachePath(sourcePath)))
+		{
+			return false;
+		}
+
+		const DDS_header *h = reinterpret_cast<const DDS_header *>(this->file.Data());
+		if (this->file.Size() < sizeof(DDS_header) || h->dwMagic != fourCC("DDS ") || h->dwSize != 124 ||
+			h->dwReserved1[0] != TEXTURE_CACHE_TAG || h->dwReserved1[1] != TEXTURE_CACHE_VERSION ||
+			!sameStamp(h, stamp) || h->dwReserved1[6] != static_cast<uint32_t>(format) ||
+			h->dwWidth == 0 || h->dwHeight == 0 || h->dwMipMapCount == 0 ||
+			h->dwMipMapCount > FullLevelCount(h->dwWidth, h->dwHeight))
+		{
+			this->file.Close();
+			return false;
+		}
+
+		this->format = format;
+		this->levels.clear();
+		int width = static_cast<int>(h->dwWidth), height = static_cast<int>(h->dwHeight);
+		size_t offset = 0;
+		for (GLuint l = 0; l < h->dwMipMapCount; l++)
+		{
+			TextureLevel level;
+			level.width = width;
+			level.height = height;
+			level.offset = offset;
+			level.size = LevelSize(format, width, height);
+			this->levels.push_back(level);
+
+			offset += level.size;
+			width = max(1, width / 2);
+			height = max(1, height / 2);
+		}
+		if (sizeof(DDS_header) + offset > this->file.Size())
+		{
+			this->Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void Close()
+	{
+		this->file.Close();
+		this->levels.clear();
+	}
+
+	TextureFormat Format() const
+	{
+		return this->format;
+	}
+
+	int Width() const
+	{
+		return this->levels.empty() ? 0 : this->levels[0].width;
+	}
+
+	int Height() const
+	{
+		return this->levels.empty() ? 0 : this->levels[0].height;
+	}
+
+	// Mip levels in the file, LOD0 first
+	const vector<TextureLevel> &Levels() const
+	{
+		return this->levels;
+	}
+
+	// Every level one after the other, top row first as SOIL decodes them. Valid while the cache is open.
+	const unsigned char *Data() const
+	{
+		return this->levels.empty() ? nullptr : this->file.Data() + sizeof(DDS_header);
+	}
+
+	// Bytes from Data() to the end of the last level
+	size_t DataSize() const
+	{
+		return this->levels.empty() ? 0 : this->levels.back().offset + this->levels.back().size;
+	}
+
+	// Writes the cache for the given image from its decoded RGB pixels: builds the mip chain and compresses every
+	// level if the format asks for it
+	static bool Write(const string &sourcePath, int width, int height, const unsigned char *pixels, TextureFormat format)
+	{
+		FileStamp stamp;
+		if (!GetAssetStamp(sourcePath, stamp) || width <= 0 || height <= 0)
+		{
+			return false;
+		}
+
+		vector<unsigned char> chain;
+		vector<pair<int, int> > levelSizes;
+		BuildMipChain(pixels, width, height, chain, levelSizes);
+		GLuint levelCount = static_cast<GLuint>(levelSizes.size());
+
+		DDS_header h;
+		memset(&h, 0, sizeof(h));
+		h.dwMagic = fourCC("DDS ");
+		h.dwSize = 124;
+		h.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+		h.dwWidth = static_cast<unsigned int>(width);
+		h.dwHeight = static_cast<unsigned int>(height);
+		h.dwMipMapCount = levelCount;
+		h.sPixelFormat.dwSize = 32;
+		if (format == TEXTURE_FORMAT_DXT1)
+		{
+			h.dwFlags |= DDSD_LINEARSIZE;
+			h.dwPitchOrLinearSize = static_cast<unsigned int>(LevelSize(format, width, height));
+			h.sPixelFormat.dwFlags = DDPF_FOURCC;
+			h.sPixelFormat.dwFourCC = fourCC("DXT1");
+		}
+		else
+		{
+			// Bytes in R, G, B order, as SOIL returns them
+			h.dwFlags |= DDSD_PITCH;
+			h.dwPitchOrLinearSize = static_cast<unsigned int>(width * 3);
+			h.sPixelFormat.dwFlags = DDPF_RGB;
+			h.sPixelFormat.dwRGBBitCount = 24;
+			h.sPixelFormat.dwRBitMask = 0x0000ff;
+			h.sPixelFormat.dwGBitMask = 0x00ff00;
+			h.sPixelFormat.dwBBitMask = 0xff0000;
+		}
+		h.sCaps.dwCaps1 = DDSCAPS_TEXTURE | (levelCount > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+		h.dwReserved1[0] = TEXTURE_CACHE_TAG;
+		h.dwReserved1[1] = TEXTURE_CACHE_VERSION;
+		h.dwReserved1[2] = static_cast<uint32_t>(uint64_t(stamp.size));
+		h.dwReserved1[3] = static_cast<uint32_t>(uint64_t(stamp.size) >> 32);
+		h.dwReserved1[4] = static_cast<uint32_t>(uint64_t(stamp.mtime));
+		h.dwReserved1[5] = static_cast<uint32_t>(uint64_t(stamp.mtime) >> 32);
+		h.dwReserved1[6] = static_cast<uint32_t>(format);
+
+		vector<unsigned char> blob(reinterpret_cast<const unsigned char *>(&h), reinterpret_cast<const unsigned char *>(&h) + sizeof(h));
+		if (format == TEXTURE_FORMAT_DXT1)
+		{
+			const unsigned char *level = chain.data();
+			for (GLuint l = 0; l < levelCount; l++)
+			{
+				if (!compressLevel(level, levelSizes[l].first, levelSizes[l].second, blob))
+				{
+					return false;
+				}
+				level += size_t(levelSizes[l].first) * levelSizes[l].second * 3;
+			}
+		}
+		else
+		{
+			blob.insert(blob.end(), chain.begin(), chain.end());
+		}
+
+		if (!WriteFileAtomic(CachePath(sourcePath), blob.data(), blob.size()))
+		{
+			cout << "ERROR::TEXTURE_CACHE::WRITE_FAILED " << CachePath(sourcePath) << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	AssetFile file;
+	TextureFormat format = TEXTURE_FORMAT_RGB;
+	vector<TextureLevel> levels;
+
+	// Appends the DXT1 blocks of an RGB8 level. Bands of rows are compressed in parallel: blocks are stored row of
+	// blocks after row of blocks, so the bands just follow each other.
+	static bool compressLevel(const unsigned char *pixels, int width, int height, vector<unsigned char> &blob)
+	{
+		size_t offset = blob.size();
+		size_t bandBytes = LevelSize(TEXTURE_FORMAT_DXT1, width, DXT_BAND_ROWS);
+		blob.resize(offset + LevelSize(TEXTURE_FORMAT_DXT1, width, height));
+
+		atomic<bool> failed(false);
+		size_t bands = (height + DXT_BAND_ROWS - 1) / DXT_BAND_ROWS;
+		ThreadPool::Shared().ParallelFor(bands, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t b = begin; b < end; b++)
+			{
+				int rows = min(DXT_BAND_ROWS, height - static_cast<int>(b) * DXT_BAND_ROWS);
+				int size = 0;
+				unsigned char *compressed = convert_image_to_DXT1(pixels + b * DXT_BAND_ROWS * size_t(width) * 3, width, rows, 3, &size);
+				if (!compressed)
+				{
+					failed = true;
+					continue;
+				}
+				memcpy(&blob[offset + b * bandBytes], compressed, size);
+				free(compressed);
+			}
+		});
+
+		return !failed;
+	}
+
+	static uint32_t fourCC(const char *code)
+	{
+		return uint32_t(code[0]) | (uint32_t(code[1]) << 8) | (uint32_t(code[2]) << 16) | (uint32_t(code[3]) << 24);
+	}
+
+	static bool sameStamp(const DDS_header *h, const FileStamp &stamp)
+	{
+		uint64_t size = uint64_t(h->dwReserved1[2]) | (uint64_t(h->dwReserved1[3]) << 32);
+		uint64_t mtime = uint64_t(h->dwReserved1[4]) | (uint64_t(h->dwReserved1[5]) << 32);
+		return size == uint64_t(stamp.size) && mtime == uint64_t(stamp.mtime);
+	}
+};
@@ -0,0 +1,690 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+#include <GL/glew.h>
+#include "SOIL2/SOIL2.h"
+
+#include "ThreadPool.h"
+#include "TextureCache.h"
+#include "TextureBindings.h"
+
+using namespace std;
+
+// What the loader learned about a texture once its image was decoded
+struct TextureInfo
+{
+	int width;
+	int height;
+	float decodeMs;
+	size_t gpuBytes;		// Mip levels resident on the GPU, in the format the texture was uploaded in
+};
+
+// Figures of the mip streaming, since startup
+struct TextureStreamingStats
+{
+	size_t residentBytes;	// Every texture, streamed or not
+	size_t budgetBytes;
+	GLuint levelsLoaded;
+	GLuint levelsEvicted;
+	float averageLatencyMs;	// From the first frame a finer level is asked for to the frame it is all there
+	float maxLatencyMs;
+};
+
+// Number of pixel buffer objects uploads rotate through
+const GLuint TEXTURE_UPLOAD_RING_SIZE = 3;
+// Bytes uploaded per Update(), keeps a burst of finished decodes from stalling a frame
+const size_t TEXTURE_UPLOAD_BUDGET = 32 * 1024 * 1024;
+// Longest side of the finest level a streamed texture starts with
+const int TEXTURE_STREAM_START_SIZE = 128;
+// Texels wanted along the longest side of a texture per pixel its model covers on screen. UV layouts leave part of
+// the texture unused and show each part once, so a model needs more texels than it covers pixels.
+const float TEXTURE_STREAM_TEXELS_PER_PIXEL = 2.0f;
+// Seconds between two printed streaming reports
+const double TEXTURE_STREAM_REPORT_INTERVAL = 5.0;
+
+// Asynchronous texture pipeline. Request() hands out a texture that is immediately usable (a 1x1
+// placeholder), the image is decoded on the worker pool and Update() streams it into the same texture
+// through a ring of pixel buffer objects.
+// Textures with a cached mip chain start at their TEXTURE_STREAM_START_SIZE level. Touch() asks for finer levels
+// from the screen size of the models drawn with them, Update() brings those in one level per frame and, past the
+// StreamingBudget(), drops the finest levels of the least recently used textures.
+class TextureLoader
+{
+public:
+	static TextureLoader &Instance()
+	{
+		static TextureLoader loader;
+		return loader;
+	}
+
+	// Video memory textures may use before the least recently used ones lose their finest levels
+	static size_t &StreamingBudget()
+	{
+		static size_t budget = 256 * 1024 * 1024;
+		return budget;
+	}
+
+	// Returns the texture for the given image file, resident or not yet. Must be called on the GL context thread.
+	GLuint Request(const string &filename)
+	{
+		GLuint textureID = createPlaceholder();
+		this->submit(filename, textureID);
+		return textureID;
+	}
+
+	// Decodes the image file of a texture again, e.g. after it changed on disk. The texture keeps its current image
+	// until Update() uploads the new one. Must be called on the GL context thread.
+	void Reload(const string &filename, GLuint textureID)
+	{
+		// Unmaps the old cache too, which would keep it from being replaced on Windows
+		this->Forget(vector<GLuint>(1, textureID));
+		this->submit(filename, textureID);
+	}
+
+	// Uploads decoded images into their textures, then the mip levels streaming asks for, at most
+	// TEXTURE_UPLOAD_BUDGET bytes per call. Call once per frame on the GL context thread.
+	void Update()
+	{
+		size_t uploadedBytes = 0;
+
+		while (uploadedBytes < TEXTURE_UPLOAD_BUDGET)
+		{
+			Decoded image;
+			{
+				lock_guard<mutex> lock(this->queueMutex);
+				if (this->decoded.empty())
+				{
+					break;
+				}
+				image = this->decoded.front();
+			}
+
+			if (image.pixels)
+			{
+				// A cached chain goes up from its starting level and is streamed from the mapped cache from then on
+				bool streams = image.cooked && image.levels.size() > 1;
+				GLuint first = streams ? startLevel(image.levels) : 0;
+				GLuint count = static_cast<GLuint>(image.levels.size());
+				size_t bytes = levelBytes(image.levels, first, count);
+				// The slot is still being read by the GPU, try again next frame instead of stalling
+				if (!this->acquireSlot(bytes))
+				{
+					break;
+				}
+				this->upload(image.textureID, image.format, image.levels, image.pixels, first, count);
+				uploadedBytes += bytes;
+
+				glBindTexture(GL_TEXTURE_2D, image.textureID);
+				if (count > 1)
+				{
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(first));
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(count - 1));
+				}
+				else
+				{
+					// A reloaded texture may have been streamed before
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+					glGenerateMipmap(GL_TEXTURE_2D);
+					// Plus the chain glGenerateMipmap adds
+					bytes = bytes * 4 / 3;
+				}
+				glBindTexture(GL_TEXTURE_2D, 0);
+				this->addResidentBytes(image.textureID, static_cast<ptrdiff_t>(bytes));
+
+				if (streams)
+				{
+					Streamed texture;
+					texture.cache = image.cooked;
+					texture.format = image.format;
+					texture.levels = image.levels;
+					texture.startLevel = first;
+					texture.residentLevel = first;
+					texture.wantedLevel = first;
+					texture.lastUsed = 0;
+					texture.requestTime = -1.0;
+					// Reloaded while its previous decode was still queued
+					map<GLuint, Streamed>::iterator previous = this->streamed.find(image.textureID);
+					if (previous != this->streamed.end())
+					{
+						delete previous->second.cache;
+					}
+					this->streamed[image.textureID] = texture;
+
+					// The mapping now belongs to the streamed texture
+					image.cooked = nullptr;
+					image.pixels = nullptr;
+				}
+			}
+			release(image);
+
+			lock_guard<mutex> lock(this->queueMutex);
+			this->decoded.pop_front();
+			this->resident++;
+			if (this->resident == this->requested)
+			{
+				ostringstream log;
+				log << "TEXTURE::LOADER:: " << this->resident << " textures resident after "
+					<< chrono::duration<float, milli>(chrono::high_resolution_clock::now() - this->batchStart).count() << " ms" << endl;
+				cout << log.str();
+			}
+		}
+
+		this->stream(uploadedBytes);
+
+		// Uploads bind the textures they fill
+		TextureBindings::Instance().Invalidate();
+	}
+
+	// Asks for the texture to be sharp enough for a model covering screenSize pixels (its projected diameter) this
+	// frame. Call on the GL context thread for every draw that uses the texture.
+	void Touch(GLuint textureID, float screenSize)
+	{
+		map<GLuint, Streamed>::iterator it = this->streamed.find(textureID);
+		if (it == this->streamed.end())
+		{
+			return;
+		}
+
+		Streamed &texture = it->second;
+		float needed = screenSize * TEXTURE_STREAM_TEXELS_PER_PIXEL;
+		GLuint level = 0;
+		while (level + 1 < texture.levels.size() && max(texture.levels[level + 1].width, texture.levels[level + 1].height) >= needed)
+		{
+			level++;
+		}
+		texture.wantedLevel = min(texture.wantedLevel, level);
+		texture.lastUsed = this->frame;
+	}
+
+	// Drops what the loader keeps about textures about to be deleted. Must be called on the GL context thread.
+	void Forget(const vector<GLuint> &textureIDs)
+	{
+		for (size_t i = 0; i < textureIDs.size(); i++)
+		{
+			map<GLuint, Streamed>::iterator it = this->streamed.find(textureIDs[i]);
+			if (it != this->streamed.end())
+			{
+				delete it->second.cache;
+				this->streamed.erase(it);
+			}
+
+			lock_guard<mutex> lock(this->queueMutex);
+			map<GLuint, TextureInfo>::iterator info = this->info.find(textureIDs[i]);
+			if (info != this->info.end())
+			{
+				this->residentBytes -= info->second.gpuBytes;
+				this->info.erase(info);
+			}
+		}
+	}
+
+	TextureStreamingStats StreamingStats()
+	{
+		TextureStreamingStats stats;
+		{
+			lock_guard<mutex> lock(this->queueMutex);
+			stats.residentBytes = this->residentBytes;
+		}
+		stats.budgetBytes = StreamingBudget();
+		stats.levelsLoaded = this->levelsLoaded;
+		stats.levelsEvicted = this->levelsEvicted;
+		stats.averageLatencyMs = this->latencyCount > 0 ? static_cast<float>(this->latencySum / this->latencyCount * 1000.0) : 0.0f;
+		stats.maxLatencyMs = static_cast<float>(this->latencyMax * 1000.0);
+		return stats;
+	}
+
+	// Size and decode cost of a texture, false while its image is still being decoded
+	bool GetInfo(GLuint textureID, TextureInfo &out)
+	{
+		lock_guard<mutex> lock(this->queueMutex);
+		map<GLuint, TextureInfo>::const_iterator it = this->info.find(textureID);
+		if (it == this->info.end())
+		{
+			return false;
+		}
+
+		out = it->second;
+		return true;
+	}
+
+	// Textures requested but not uploaded yet
+	GLuint Pending()
+	{
+		lock_guard<mutex> lock(this->queueMutex);
+		return this->requested - this->resident;
+	}
+
+private:
+	struct Decoded
+	{
+		GLuint textureID;
+		TextureFormat format;
+		vector<TextureLevel> levels;	// LOD0 first, offsets from pixels
+		const unsigned char *pixels;
+		TextureCache *cooked;		// Owns the pixels when they come from a cooked texture, SOIL does otherwise
+	};
+
+	// Mip levels of a texture above its starting one, which come and go with its screen size
+	struct Streamed
+	{
+		TextureCache *cache;		// Mapped for as long as the texture lives
+		TextureFormat format;
+		vector<TextureLevel> levels;
+		GLuint startLevel;			// Never evicted
+		GLuint residentLevel;		// Finest level on the GPU, the texture's GL_TEXTURE_BASE_LEVEL
+		GLuint wantedLevel;			// Finest level asked for by the draws of the current frame
+		uint64_t lastUsed;			// Frame of the last Touch()
+		double requestTime;			// Time the pending finer level was first asked for, negative if none
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		size_t capacity;
+		GLsync fence;
+	};
+
+	ThreadPool &pool;
+	mutex queueMutex;
+	deque<Decoded> decoded;
+	map<GLuint, TextureInfo> info;
+	GLuint requested;
+	GLuint resident;
+	chrono::high_resolution_clock::time_point batchStart;
+
+	Slot slots[TEXTURE_UPLOAD_RING_SIZE];
+	GLuint nextSlot;
+
+	// Streaming state, only touched on the GL context thread. residentBytes is guarded by queueMutex like info.
+	map<GLuint, Streamed> streamed;
+	uint64_t frame;
+	size_t residentBytes;
+	GLuint levelsLoaded;
+	GLuint levelsEvicted;
+	double latencySum;
+	double latencyMax;
+	GLuint latencyCount;
+	chrono::steady_clock::time_point startTime;
+	double lastReport;
+
+	// The pool is created first so it outlives the loader and its pending decodes
+	TextureLoader() : pool(ThreadPool::Shared()), requested(0), resident(0), nextSlot(0), frame(1), residentBytes(0), levelsLoaded(0),
+		levelsEvicted(0), latencySum(0.0), latencyMax(0.0), latencyCount(0), startTime(chrono::steady_clock::now()), lastReport(0.0)
+	{
+		for (GLuint i = 0; i < TEXTURE_UPLOAD_RING_SIZE; i++)
+		{
+			this->slots[i].buffer = 0;
+			this->slots[i].capacity = 0;
+			this->slots[i].fence = 0;
+		}
+	}
+
+	~TextureLoader()
+	{
+		// Let pending decodes finish before the queue goes away. GL objects die with the context.
+		this->pool.Wait();
+
+		lock_guard<mutex> lock(this->queueMutex);
+		for (size_t i = 0; i < this->decoded.size(); i++)
+		{
+			release(this->decoded[i]);
+		}
+		for (map<GLuint, Streamed>::iterator it = this->streamed.begin(); it != this->streamed.end(); ++it)
+		{
+			delete it->second.cache;
+		}
+	}
+
+	TextureLoader(const TextureLoader &);
+	TextureLoader &operator=(const TextureLoader &);
+
+	static void release(const Decoded &image)
+	{
+		if (image.cooked)
+		{
+			delete image.cooked;
+		}
+		else if (image.pixels)
+		{
+			SOIL_free_image_data(const_cast<unsigned char *>(image.pixels));
+		}
+	}
+
+	// First level no larger than TEXTURE_STREAM_START_SIZE, or the last one
+	static GLuint startLevel(const vector<TextureLevel> &levels)
+	{
+		GLuint level = 0;
+		while (level + 1 < levels.size() && max(levels[level].width, levels[level].height) > TEXTURE_STREAM_START_SIZE)
+		{
+			level++;
+		}
+		return level;
+	}
+
+	// Bytes of levels [first, last)
+	static size_t levelBytes(const vector<TextureLevel> &levels, GLuint first, GLuint last)
+	{
+		return levels[last - 1].offset + levels[last - 1].size - levels[first].offset;
+	}
+
+	double now() const
+	{
+		return chrono::duration<double>(chrono::steady_clock::now() - this->startTime).count();
+	}
+
+	void addResidentBytes(GLuint textureID, ptrdiff_t bytes)
+	{
+		lock_guard<mutex> lock(this->queueMutex);
+		this->residentBytes += bytes;
+		this->info[textureID].gpuBytes += bytes;
+	}
+
+	// Brings streamed textures one level closer to what the last frame's draws asked for, finest requests first,
+	// within what is left of the upload budget. Then evicts down to the budget and starts the next frame.
+	void stream(size_t uploadedBytes)
+	{
+		double time = this->now();
+
+		vector<pair<GLuint, GLuint> > pending;		// Levels missing, texture
+		for (map<GLuint, Streamed>::iterator it = this->streamed.begin(); it != this->streamed.end(); ++it)
+		{
+			Streamed &texture = it->second;
+			if (texture.wantedLevel < texture.residentLevel)
+			{
+				if (texture.requestTime < 0.0)
+				{
+					texture.requestTime = time;
+				}
+				pending.push_back(make_pair(texture.residentLevel - texture.wantedLevel, it->first));
+			}
+			else
+			{
+				texture.requestTime = -1.0;
+			}
+		}
+		sort(pending.begin(), pending.end(), [](const pair<GLuint, GLuint> &a, const pair<GLuint, GLuint> &b) { return a.first > b.first; });
+
+		for (size_t i = 0; i < pending.size() && uploadedBytes < TEXTURE_UPLOAD_BUDGET; i++)
+		{
+			GLuint textureID = pending[i].second;
+			Streamed &texture = this->streamed[textureID];
+			GLuint level = texture.residentLevel - 1;
+			size_t bytes = texture.levels[level].size;
+			if (!this->makeRoom(bytes))
+			{
+				break;
+			}
+			if (!this->acquireSlot(bytes))
+			{
+				break;
+			}
+
+			this->upload(textureID, texture.format, texture.levels, texture.cache->Data(), level, level + 1);
+			glBindTexture(GL_TEXTURE_2D, textureID);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level));
+			glBindTexture(GL_TEXTURE_2D, 0);
+			uploadedBytes += bytes;
+			this->addResidentBytes(textureID, static_cast<ptrdiff_t>(bytes));
+			texture.residentLevel = level;
+			this->levelsLoaded++;
+
+			if (texture.residentLevel <= texture.wantedLevel)
+			{
+				double latency = time - texture.requestTime;
+				this->latencySum += latency;
+				this->latencyMax = max(this->latencyMax, latency);
+				this->latencyCount++;
+				texture.requestTime = -1.0;
+			}
+		}
+
+		// The budget may have been lowered
+		this->makeRoom(0);
+
+		for (map<GLuint, Streamed>::iterator it = this->streamed.begin(); it != this->streamed.end(); ++it)
+		{
+			it->second.wantedLevel = it->second.startLevel;
+		}
+		this->frame++;
+
+		if (time - this->lastReport >= TEXTURE_STREAM_REPORT_INTERVAL && !this->streamed.empty())
+		{
+			this->lastReport = time;
+			TextureStreamingStats stats = this->StreamingStats();
+			ostringstream log;
+			log << "TEXTURE::STREAMING:: " << stats.residentBytes / (1024 * 1024) << " of " << stats.budgetBytes / (1024 * 1024) << " MB resident, "
+				<< stats.levelsLoaded << " levels streamed in, " << stats.levelsEvicted << " evicted, latency "
+				<< stats.averageLatencyMs << " ms average, " << stats.maxLatencyMs << " ms max" << endl;
+			cout << log.str();
+		}
+	}
+
+	// Drops the finest level of the least recently used textures until bytes more fit in the budget. Textures
+	// drawn in the current frame and starting levels are kept. Returns false if that does not free enough.
+	bool makeRoom(size_t bytes)
+	{
+		while (true)
+		{
+			{
+				lock_guard<mutex> lock(this->queueMutex);
+				if (this->residentBytes + bytes <= StreamingBudget())
+				{
+					return true;
+				}
+			}
+
+			map<GLuint, Streamed>::iterator victim = this->streamed.end();
+			for (map<GLuint, Streamed>::iterator it = this->streamed.begin(); it != this->streamed.end(); ++it)
+			{
+				if (it->second.residentLevel < it->second.startLevel && it->second.lastUsed < this->frame &&
+					(victim == this->streamed.end() || it->second.lastUsed < victim->second.lastUsed))
+				{
+					victim = it;
+				}
+			}
+			if (victim == this->streamed.end())
+			{
+				return false;
+			}
+
+			// Levels under the base level are ignored, a 0x0 image gives their memory back
+			Streamed &texture = victim->second;
+			glBindTexture(GL_TEXTURE_2D, victim->first);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(texture.residentLevel + 1));
+			glTexImage2D(GL_TEXTURE_2D, texture.residentLevel, GL_RGB, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			this->addResidentBytes(victim->first, -static_cast<ptrdiff_t>(texture.levels[texture.residentLevel].size));
+			texture.residentLevel++;
+			this->levelsEvicted++;
+		}
+	}
+
+	// Queues the decode of an image file into a texture
+	void submit(const string &filename, GLuint textureID)
+	{
+		{
+			lock_guard<mutex> lock(this->queueMutex);
+			if (this->requested == this->resident)
+			{
+				this->batchStart = chrono::high_resolution_clock::now();
+			}
+			this->requested++;
+		}
+
+		// Block compression needs EXT_texture_compression_s3tc, which every desktop driver has but a check is cheap
+		TextureFormat format = TextureCache::DefaultFormat();
+		if (format == TEXTURE_FORMAT_DXT1 && !GLEW_EXT_texture_compression_s3tc)
+		{
+			format = TEXTURE_FORMAT_RGB;
+		}
+
+		this->pool.Submit([this, filename, textureID, format]
+		{
+			chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+			Decoded image;
+			image.textureID = textureID;
+			image.format = TEXTURE_FORMAT_RGB;
+			image.pixels = nullptr;
+
+			// A cooked copy only needs mapping. Otherwise the image is decoded and cooked now for the next launches.
+			image.cooked = new TextureCache();
+			if (!image.cooked->Open(filename, format))
+			{
+				int width = 0, height = 0;
+				AssetFile file;
+				unsigned char *pixels = file.Open(filename) ?
+					SOIL_load_image_from_memory(file.Data(), static_cast<int>(file.Size()), &width, &height, 0, SOIL_LOAD_RGB) : nullptr;
+				file.Close();
+				if (pixels && TextureCache::Write(filename, width, height, pixels, format) && image.cooked->Open(filename, format))
+				{
+					SOIL_free_image_data(pixels);
+				}
+				else
+				{
+					// Not cached, upload the decoded image as is
+					delete image.cooked;
+					image.cooked = nullptr;
+					image.pixels = pixels;
+					if (pixels)
+					{
+						TextureLevel level = { width, height, 0, TextureCache::LevelSize(TEXTURE_FORMAT_RGB, width, height) };
+						image.levels.push_back(level);
+					}
+				}
+			}
+			if (image.cooked)
+			{
+				image.format = image.cooked->Format();
+				image.levels = image.cooked->Levels();
+				image.pixels = image.cooked->Data();
+			}
+			if (!image.pixels)
+			{
+				cout << "ERROR::TEXTURE::DECODE_FAILED " + filename + "\n";
+			}
+
+			TextureInfo info;
+			info.width = image.levels.empty() ? 0 : image.levels[0].width;
+			info.height = image.levels.empty() ? 0 : image.levels[0].height;
+			info.decodeMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+			info.gpuBytes = 0;
+
+			lock_guard<mutex> lock(this->queueMutex);
+			this->decoded.push_back(image);
+			this->info[textureID] = info;
+		});
+	}
+
+	GLuint createPlaceholder()
+	{
+		static const unsigned char white[3] = { 255, 255, 255 };
+
+		GLuint textureID;
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, white);
+
+		// Parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		TextureBindings::Instance().Invalidate();
+
+		return textureID;
+	}
+
+	// Makes the next ring slot ready to receive the given number of bytes. Returns false if the GPU still uses it.
+	bool acquireSlot(size_t bytes)
+	{
+		Slot &slot = this->slots[this->nextSlot];
+
+		if (slot.fence)
+		{
+			GLenum state = glClientWaitSync(slot.fence, 0, 0);
+			if (state == GL_TIMEOUT_EXPIRED)
+			{
+				return false;
+			}
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+		}
+
+		if (!slot.buffer)
+		{
+			glGenBuffers(1, &slot.buffer);
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		if (slot.capacity < bytes)
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+			slot.capacity = bytes;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		return true;
+	}
+
+	// Copies levels [first, last) into the current slot and sources the texture's levels from it
+	void upload(GLuint textureID, TextureFormat format, const vector<TextureLevel> &levels, const unsigned char *pixels, GLuint first, GLuint last)
+	{
+		Slot &slot = this->slots[this->nextSlot];
+		this->nextSlot = (this->nextSlot + 1) % TEXTURE_UPLOAD_RING_SIZE;
+
+		size_t begin = levels[first].offset;
+		size_t bytes = levelBytes(levels, first, last);
+
+		// With a buffer bound to GL_PIXEL_UNPACK_BUFFER the data pointer is an offset into it
+		const unsigned char *source = nullptr;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (dst)
+		{
+			memcpy(dst, pixels + begin, bytes);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		else
+		{
+			// Mapping failed, fall back to a plain upload from client memory
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			source = pixels + begin;
+		}
+
+		// RGB rows are tightly packed
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		for (GLuint l = first; l < last; l++)
+		{
+			const TextureLevel &level = levels[l];
+			size_t offset = level.offset - begin;
+			const GLvoid *data = source ? static_cast<const GLvoid *>(source + offset) : reinterpret_cast<const GLvoid *>(offset);
+			if (format == TEXTURE_FORMAT_DXT1)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, l, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, level.width, level.height, 0, static_cast<GLsizei>(level.size), data);
+			}
+			else
+			{
+				glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, level.width, level.height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_MIPS_SSE2
+#endif
+
+#include "SOIL2/image_helper.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Rows of a level one ParallelFor chunk downsamples
+const size_t MIP_ROW_GRAIN = 32;
+
+// Sum of two RGB8 rows as 16-bit values, SSE2 when available
+void mipSumRows(const unsigned char *a, const unsigned char *b, size_t count, uint16_t *sum)
+{
+	size_t i = 0;
+#ifdef TEXTURE_MIPS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i ra = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+		__m128i rb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+		__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+		__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(sum + i), low);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(sum + i + 8), high);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		sum[i] = static_cast<uint16_t>(a[i] + b[i]);
+	}
+}
+
+// Next level of an RGB8 image: a 2x2 box filter, the same one SOIL2's mipmap_image applies, with a last odd row or
+// column dropped. Rows are spread over the shared pool; levels one texel wide or high go through mipmap_image itself.
+void DownsampleBox(const unsigned char *source, int width, int height, unsigned char *result)
+{
+	int nextWidth = max(1, width / 2), nextHeight = max(1, height / 2);
+	if (width < 2 || height < 2)
+	{
+		mipmap_image(source, width, height, 3, result, width > 1 ? 2 : 1, height > 1 ? 2 : 1);
+		return;
+	}
+
+	size_t sourceStride = size_t(width) * 3;
+	size_t resultStride = size_t(nextWidth) * 3;
+	ThreadPool::Shared().ParallelFor(nextHeight, MIP_ROW_GRAIN, [=](size_t begin, size_t end)
+	{
+		vector<uint16_t> sum(size_t(nextWidth) * 2 * 3);
+		for (size_t y = begin; y < end; y++)
+		{
+			const unsigned char *top = source + 2 * y * sourceStride;
+			mipSumRows(top, top + sourceStride, sum.size(), sum.data());
+
+			unsigned char *out = result + y * resultStride;
+			for (size_t x = 0; x < resultStride; x += 3)
+			{
+				const uint16_t *s = &sum[2 * x];
+				out[x] = static_cast<unsigned char>((s[0] + s[3] + 2) >> 2);
+				out[x + 1] = static_cast<unsigned char>((s[1] + s[4] + 2) >> 2);
+				out[x + 2] = static_cast<unsigned char>((s[2] + s[5] + 2) >> 2);
+			}
+		}
+	});
+}
+
+// Full mip chain of an RGB8 image, down to 1x1, every level one after the other in chain (LOD0 included).
+// levelSizes receives the width and height of each level.
+void BuildMipChain(const unsigned char *pixels, int width, int height, vector<unsigned char> &chain, vector<pair<int, int> > &levelSizes)
+{
+	size_t total = 0;
+	levelSizes.clear();
+	for (int w = width, h = height; ; w = max(1, w / 2), h = max(1, h / 2))
+	{
+		levelSizes.push_back(make_pair(w, h));
+		total += size_t(w) * h * 3;
+		if (w == 1 && h == 1)
+		{
+			break;
+		}
+	}
+
+	chain.resize(total);
+	copy(pixels, pixels + size_t(width) * height * 3, chain.begin());
+
+	size_t offset = 0;
+	for (size_t l = 0; l + 1 < levelSizes.size(); l++)
+	{
+		size_t bytes = size_t(levelSizes[l].first) * levelSizes[l].second * 3;
+		DownsampleBox(&chain[offset], levelSizes[l].first, levelSizes[l].second, &chain[offset + bytes]);
+		offset += bytes;
+	}
+}
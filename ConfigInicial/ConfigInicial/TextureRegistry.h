@@ -0,0 +1,219 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include "TextureLoader.h"
+
+using namespace std;
+
+// Process-wide, reference-counted set of textures shared by every Model. A texture is found by its
+// normalized path or, for copies of the same image in other folders, by the hash of the file contents.
+class TextureRegistry
+{
+public:
+	static TextureRegistry &Instance()
+	{
+		static TextureRegistry registry;
+		return registry;
+	}
+
+	// Returns the texture for an image file and adds a reference to it. contentHash is HashFile() of the
+	// image, 0 if unknown. Must be called on the GL context thread.
+	GLuint Acquire(const string &filename, uint64_t contentHash)
+	{
+		lock_guard<mutex> lock(this->registryMutex);
+		string key = NormalizePath(filename);
+
+		unordered_map<string, GLuint>::iterator byPath = this->paths.find(key);
+		if (byPath != this->paths.end())
+		{
+			Entry &entry = this->entries[byPath->second];
+			entry.refs++;
+			entry.shares++;
+			this->pathHits++;
+			return byPath->second;
+		}
+
+		if (contentHash != 0)
+		{
+			unordered_map<uint64_t, GLuint>::iterator byContent = this->contents.find(contentHash);
+			if (byContent != this->contents.end())
+			{
+				Entry &entry = this->entries[byContent->second];
+				entry.refs++;
+				entry.shares++;
+				entry.paths.push_back(key);
+				this->paths[key] = byContent->second;
+				this->contentHits++;
+				return byContent->second;
+			}
+		}
+
+		GLuint textureID = TextureLoader::Instance().Request(filename);
+
+		Entry entry;
+		entry.refs = 1;
+		entry.shares = 0;
+		entry.contentHash = contentHash;
+		entry.paths.push_back(key);
+		this->entries[textureID] = entry;
+		this->paths[key] = textureID;
+		if (contentHash != 0)
+		{
+			this->contents[contentHash] = textureID;
+		}
+
+		return textureID;
+	}
+
+	// Drops a reference. The last one queues the texture for deletion by Collect(). Safe to call from any thread.
+	void Release(GLuint textureID)
+	{
+		lock_guard<mutex> lock(this->registryMutex);
+
+		unordered_map<GLuint, Entry>::iterator it = this->entries.find(textureID);
+		if (it == this->entries.end() || --it->second.refs > 0)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < it->second.paths.size(); i++)
+		{
+			this->paths.erase(it->second.paths[i]);
+		}
+		if (it->second.contentHash != 0)
+		{
+			this->contents.erase(it->second.contentHash);
+		}
+		this->entries.erase(it);
+		this->garbage.push_back(textureID);
+	}
+
+	// Decodes an image file again, which keeps being drawn with the old image until the new one is uploaded.
+	// A texture only this path resolves to is reloaded in place. One shared by content with other paths stays
+	// theirs, with the old image: the path moves to a new texture, with no references until the models using it
+	// acquire it again (split is set then). Returns the texture that gets the new image, 0 if no model uses the file.
+	// Must be called on the GL context thread.
+	GLuint Reload(const string &filename, bool &split)
+	{
+		lock_guard<mutex> lock(this->registryMutex);
+		split = false;
+
+		string key = NormalizePath(filename);
+		unordered_map<string, GLuint>::iterator byPath = this->paths.find(key);
+		if (byPath == this->paths.end())
+		{
+			return 0;
+		}
+
+		Entry &entry = this->entries[byPath->second];
+		if (entry.paths.size() > 1)
+		{
+			entry.paths.erase(find(entry.paths.begin(), entry.paths.end(), key));
+
+			GLuint textureID = TextureLoader::Instance().Request(filename);
+			Entry moved;
+			moved.refs = 0;
+			moved.shares = 0;
+			moved.contentHash = 0;
+			moved.paths.push_back(key);
+			this->entries[textureID] = moved;
+			byPath->second = textureID;
+			split = true;
+			return textureID;
+		}
+
+		// The texture no longer matches its content hash
+		if (entry.contentHash != 0)
+		{
+			this->contents.erase(entry.contentHash);
+			entry.contentHash = 0;
+		}
+
+		TextureLoader::Instance().Reload(filename, byPath->second);
+		return byPath->second;
+	}
+
+	// Deletes the textures released since the last call. Must be called on the GL context thread.
+	void Collect()
+	{
+		lock_guard<mutex> lock(this->registryMutex);
+		if (!this->garbage.empty())
+		{
+			TextureLoader::Instance().Forget(this->garbage);
+			glDeleteTextures(static_cast<GLsizei>(this->garbage.size()), this->garbage.data());
+			// Deleting a bound texture unbinds it, and its name may come back for another one
+			TextureBindings::Instance().Invalidate();
+			this->garbage.clear();
+		}
+	}
+
+	// Prints what sharing saved compared to one texture per model and file. Sizes are only known
+	// for textures whose image has been decoded already.
+	void Report()
+	{
+		lock_guard<mutex> lock(this->registryMutex);
+
+		size_t bytesSaved = 0;
+		size_t bytesUsed = 0;
+		size_t bytesUncompressed = 0;
+		float decodeMsSaved = 0.0f;
+		for (unordered_map<GLuint, Entry>::const_iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+		{
+			TextureInfo info;
+			if (!TextureLoader::Instance().GetInfo(it->first, info))
+			{
+				continue;
+			}
+
+			size_t bytes = info.gpuBytes;
+			bytesUsed += bytes;
+			// What the texture would take as RGB8 plus a full mip chain
+			bytesUncompressed += size_t(info.width) * info.height * 3 * 4 / 3;
+			bytesSaved += bytes * it->second.shares;
+			decodeMsSaved += info.decodeMs * it->second.shares;
+		}
+
+		ostringstream log;
+		log << "TEXTURE::REGISTRY:: " << this->entries.size() << " textures, " << this->pathHits << " shared by path, "
+			<< this->contentHits << " shared by content; " << bytesUsed / (1024 * 1024) << " MB on the GPU ("
+			<< bytesUncompressed / (1024 * 1024) << " MB uncompressed), "
+			<< bytesSaved / (1024 * 1024) << " MB and " << decodeMsSaved << " ms of decoding saved" << endl;
+		cout << log.str();
+	}
+
+private:
+	struct Entry
+	{
+		GLuint refs;
+		GLuint shares;			// Acquires served by this texture that would have created a new one
+		uint64_t contentHash;
+		vector<string> paths;	// Every normalized path that resolved to this texture
+	};
+
+	mutex registryMutex;
+	unordered_map<GLuint, Entry> entries;
+	unordered_map<string, GLuint> paths;
+	unordered_map<uint64_t, GLuint> contents;
+	vector<GLuint> garbage;
+	GLuint pathHits;
+	GLuint contentHits;
+
+	TextureRegistry() : pathHits(0), contentHits(0)
+	{
+		// Created first so the loader outlives the registry
+		TextureLoader::Instance();
+	}
+
+	TextureRegistry(const TextureRegistry &);
+	TextureRegistry &operator=(const TextureRegistry &);
+};
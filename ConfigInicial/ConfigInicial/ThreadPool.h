@@ -0,0 +1,186 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include "AllocationCounter.h"
+
+using namespace std;
+
+// Fixed set of worker threads consuming a FIFO of tasks. Tasks must not touch the GL context.
+class ThreadPool
+{
+public:
+	// Starts the workers, one per hardware thread when threadCount is 0
+	explicit ThreadPool(unsigned int threadCount = 0) : busy(0), stopping(false)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = thread::hardware_concurrency();
+		}
+		if (threadCount == 0)
+		{
+			threadCount = 4;
+		}
+
+		for (unsigned int i = 0; i < threadCount; i++)
+		{
+			this->workers.push_back(thread(&ThreadPool::workerLoop, this));
+		}
+	}
+
+	// Finishes the queued tasks and joins the workers
+	~ThreadPool()
+	{
+		{
+			lock_guard<mutex> lock(this->queueMutex);
+			this->stopping = true;
+		}
+		this->taskAvailable.notify_all();
+
+		for (size_t i = 0; i < this->workers.size(); i++)
+		{
+			this->workers[i].join();
+		}
+	}
+
+	// Process-wide pool shared by the loaders
+	static ThreadPool &Shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	void Submit(function<void()> task)
+	{
+		{
+			lock_guard<mutex> lock(this->queueMutex);
+			this->tasks.push_back(task);
+		}
+		this->taskAvailable.notify_one();
+	}
+
+	// Blocks until every submitted task has finished
+	void Wait()
+	{
+		unique_lock<mutex> lock(this->queueMutex);
+		this->idle.wait(lock, [this] { return this->tasks.empty() && this->busy == 0; });
+	}
+
+	// Runs body(begin, end) over [0, count) in chunks of grain items, on the calling thread and whichever
+	// workers are idle. The caller works through the chunks itself, so this may be used from inside a task.
+	void ParallelFor(size_t count, size_t grain, function<void(size_t, size_t)> body)
+	{
+		size_t chunks = (count + grain - 1) / grain;
+		if (chunks <= 1)
+		{
+			if (count > 0)
+			{
+				body(0, count);
+			}
+			return;
+		}
+
+		// Shared with the helper tasks, which may start only after the caller has returned
+		struct Job
+		{
+			atomic<size_t> next;
+			atomic<size_t> done;
+			mutex doneMutex;
+			condition_variable finished;
+		};
+		shared_ptr<Job> job = make_shared<Job>();
+		job->next = 0;
+		job->done = 0;
+
+		// Allocations of the helpers count in the caller's scope
+		AllocationScope *scope = AllocationScope::Current();
+		function<void()> run = [job, chunks, count, grain, body, scope]
+		{
+			for (;;)
+			{
+				size_t chunk = job->next++;
+				if (chunk >= chunks)
+				{
+					return;
+				}
+
+				{
+					AllocationScope::Lend lend(scope);
+					body(chunk * grain, min(count, (chunk + 1) * grain));
+				}
+
+				if (++job->done == chunks)
+				{
+					lock_guard<mutex> lock(job->doneMutex);
+					job->finished.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = min(chunks - 1, this->workers.size());
+		for (size_t i = 0; i < helpers; i++)
+		{
+			this->Submit(run);
+		}
+		run();
+
+		unique_lock<mutex> lock(job->doneMutex);
+		job->finished.wait(lock, [&job, chunks] { return job->done == chunks; });
+	}
+
+	unsigned int Size() const
+	{
+		return static_cast<unsigned int>(this->workers.size());
+	}
+
+private:
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+
+	vector<thread> workers;
+	deque<function<void()>> tasks;
+	mutex queueMutex;
+	condition_variable taskAvailable;
+	condition_variable idle;
+	unsigned int busy;
+	bool stopping;
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			function<void()> task;
+			{
+				unique_lock<mutex> lock(this->queueMutex);
+				this->taskAvailable.wait(lock, [this] { return this->stopping || !this->tasks.empty(); });
+				if (this->tasks.empty())
+				{
+					return;
+				}
+
+				task = this->tasks.front();
+				this->tasks.pop_front();
+				this->busy++;
+			}
+
+			task();
+
+			{
+				lock_guard<mutex> lock(this->queueMutex);
+				this->busy--;
+				if (this->tasks.empty() && this->busy == 0)
+				{
+					this->idle.notify_all();
+				}
+			}
+		}
+	}
+};
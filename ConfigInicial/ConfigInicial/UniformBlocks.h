@@ -0,0 +1,248 @@
+#pragma once
+
+#include <iostream>
+#include <cstddef>
+#include <cstring>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "RenderStats.h"
+
+using namespace std;
+
+// Binding points of the uniform blocks every program reads its per-frame data from
+const GLuint UNIFORM_BLOCK_CAMERA = 0;
+const GLuint UNIFORM_BLOCK_LIGHTS = 1;
+// NUMBER_OF_POINT_LIGHTS in lighting.frag
+const GLuint POINT_LIGHT_COUNT = 1;
+// Frames the uniform buffer rotates through, the CPU writes one while the GPU still reads the others
+const GLuint UNIFORM_RING_FRAMES = 3;
+// Block writes a frame has room for
+const GLuint UNIFORM_RING_WRITES_PER_FRAME = 8;
+
+/*  Mirrors of the std140 blocks in the shaders. A vec3 takes 16 bytes unless a float fills its last 4,
+	structs and array elements start at multiples of 16. The asserts keep the C++ side in step.  */
+
+// layout (std140) uniform Camera in lighting.vs, lighting.frag and lamp.vs
+struct CameraBlock
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 viewPos;
+	float pad0;
+};
+static_assert(offsetof(CameraBlock, projection) == 64, "CameraBlock does not match the std140 layout");
+static_assert(offsetof(CameraBlock, viewPos) == 128, "CameraBlock does not match the std140 layout");
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock does not match the std140 layout");
+
+struct DirLightBlock
+{
+	glm::vec3 direction;
+	float pad0;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+static_assert(offsetof(DirLightBlock, ambient) == 16, "DirLightBlock does not match the std140 layout");
+static_assert(offsetof(DirLightBlock, diffuse) == 32, "DirLightBlock does not match the std140 layout");
+static_assert(offsetof(DirLightBlock, specular) == 48, "DirLightBlock does not match the std140 layout");
+static_assert(sizeof(DirLightBlock) == 64, "DirLightBlock does not match the std140 layout");
+
+struct PointLightBlock
+{
+	glm::vec3 position;
+	float constant;
+	float linear;
+	float quadratic;
+	float pad0[2];
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+static_assert(offsetof(PointLightBlock, constant) == 12, "PointLightBlock does not match the std140 layout");
+static_assert(offsetof(PointLightBlock, linear) == 16, "PointLightBlock does not match the std140 layout");
+static_assert(offsetof(PointLightBlock, quadratic) == 20, "PointLightBlock does not match the std140 layout");
+static_assert(offsetof(PointLightBlock, ambient) == 32, "PointLightBlock does not match the std140 layout");
+static_assert(offsetof(PointLightBlock, diffuse) == 48, "PointLightBlock does not match the std140 layout");
+static_assert(offsetof(PointLightBlock, specular) == 64, "PointLightBlock does not match the std140 layout");
+static_assert(sizeof(PointLightBlock) == 80, "PointLightBlock does not match the std140 layout");
+
+struct SpotLightBlock
+{
+	glm::vec3 position;
+	float pad0;
+	glm::vec3 direction;
+	float cutOff;
+	float outerCutOff;
+	float constant;
+	float linear;
+	float quadratic;
+	glm::vec3 ambient;
+	float pad1;
+	glm::vec3 diffuse;
+	float pad2;
+	glm::vec3 specular;
+	float pad3;
+};
+static_assert(offsetof(SpotLightBlock, direction) == 16, "SpotLightBlock does not match the std140 layout");
+static_assert(offsetof(SpotLightBlock, cutOff) == 28, "SpotLightBlock does not match the std140 layout");
+static_assert(offsetof(SpotLightBlock, outerCutOff) == 32, "SpotLightBlock does not match the std140 layout");
+static_assert(offsetof(SpotLightBlock, quadratic) == 44, "SpotLightBlock does not match the std140 layout");
+static_assert(offsetof(SpotLightBlock, ambient) == 48, "SpotLightBlock does not match the std140 layout");
+static_assert(offsetof(SpotLightBlock, diffuse) == 64, "SpotLightBlock does not match the std140 layout");
+static_assert(offsetof(SpotLightBlock, specular) == 80, "SpotLightBlock does not match the std140 layout");
+static_assert(sizeof(SpotLightBlock) == 96, "SpotLightBlock does not match the std140 layout");
+
+// layout (std140) uniform Lights in lighting.frag and shadow.vs. shadow.vs declares lightSpaceMatrix alone, so it goes first.
+struct LightsBlock
+{
+	glm::mat4 lightSpaceMatrix;		// Clip space of the directional light, for the shadow pass
+	DirLightBlock dirLight;
+	PointLightBlock pointLights[POINT_LIGHT_COUNT];
+	SpotLightBlock spotLight;
+};
+static_assert(offsetof(LightsBlock, dirLight) == 64, "LightsBlock does not match the std140 layout");
+static_assert(offsetof(LightsBlock, pointLights) == 128, "LightsBlock does not match the std140 layout");
+static_assert(offsetof(LightsBlock, spotLight) == 128 + 80 * POINT_LIGHT_COUNT, "LightsBlock does not match the std140 layout");
+static_assert(sizeof(LightsBlock) == 224 + 80 * POINT_LIGHT_COUNT, "LightsBlock does not match the std140 layout");
+
+// Per-frame uniform data of every program, in one buffer split into UNIFORM_RING_FRAMES regions. Each frame writes
+// its blocks into the next region, which a fence tells is no longer read by the GPU, and binds the written range to
+// the block's binding point. Programs read the same ranges, so switching programs re-sends nothing.
+// Only used on the GL context thread.
+class FrameUniforms
+{
+public:
+	static FrameUniforms &Instance()
+	{
+		static FrameUniforms uniforms;
+		return uniforms;
+	}
+
+	// Points the blocks a program declares at the shared binding points. Once per program, after it is (re)built.
+	static void BindBlocks(Shader &shader)
+	{
+		bindBlock(shader, "Camera", UNIFORM_BLOCK_CAMERA);
+		bindBlock(shader, "Lights", UNIFORM_BLOCK_LIGHTS);
+	}
+
+	// Moves on to the next region of the ring, waiting for the GPU to be done with it if it is not yet
+	void BeginFrame()
+	{
+		if (!this->buffer)
+		{
+			this->create();
+		}
+
+		this->frame = (this->frame + 1) % UNIFORM_RING_FRAMES;
+		this->cursor = 0;
+		GLsync &fence = this->fences[this->frame];
+		if (fence)
+		{
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+
+	// Marks the region of the frame as in use by the commands issued so far
+	void EndFrame()
+	{
+		this->fences[this->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// Write the block and bind it, for the draws issued from now on. Can be called again within a frame.
+	void SetCamera(const CameraBlock &camera)
+	{
+		this->write(UNIFORM_BLOCK_CAMERA, &camera, sizeof(camera));
+	}
+
+	void SetLights(const LightsBlock &lights)
+	{
+		this->write(UNIFORM_BLOCK_LIGHTS, &lights, sizeof(lights));
+	}
+
+private:
+	GLuint buffer;
+	GLsizeiptr slotSize;		// Largest block rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	GLsizeiptr regionSize;
+	GLuint frame;
+	GLsizeiptr cursor;			// Next free byte of the frame's region
+	GLsync fences[UNIFORM_RING_FRAMES];
+	bool overflowReported;
+
+	FrameUniforms() : buffer(0), slotSize(0), regionSize(0), frame(0), cursor(0), overflowReported(false)
+	{
+		for (GLuint i = 0; i < UNIFORM_RING_FRAMES; i++)
+		{
+			this->fences[i] = 0;
+		}
+	}
+
+	FrameUniforms(const FrameUniforms &);
+	FrameUniforms &operator=(const FrameUniforms &);
+
+	static void bindBlock(Shader &shader, const GLchar *name, GLuint binding)
+	{
+		GLuint index = glGetUniformBlockIndex(shader.Program, name);
+		if (index != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(shader.Program, index, binding);
+		}
+	}
+
+	void create()
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		GLsizeiptr largest = sizeof(LightsBlock) > sizeof(CameraBlock) ? sizeof(LightsBlock) : sizeof(CameraBlock);
+		this->slotSize = (largest + alignment - 1) / alignment * alignment;
+		this->regionSize = this->slotSize * UNIFORM_RING_WRITES_PER_FRAME;
+
+		glGenBuffers(1, &this->buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+		glBufferData(GL_UNIFORM_BUFFER, this->regionSize * UNIFORM_RING_FRAMES, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// Copies a block into the next slot of the frame's region and binds that range to the binding point
+	void write(GLuint binding, const void *data, GLsizeiptr bytes)
+	{
+		if (this->cursor + this->slotSize > this->regionSize)
+		{
+			if (!this->overflowReported)
+			{
+				cout << "ERROR::FRAME_UNIFORMS::MORE_THAN_" << UNIFORM_RING_WRITES_PER_FRAME << "_WRITES_IN_A_FRAME" << endl;
+				this->overflowReported = true;
+			}
+			return;
+		}
+
+		GLintptr offset = this->frame * this->regionSize + this->cursor;
+		this->cursor += this->slotSize;
+
+		// The fence waited for in BeginFrame makes the region safe to overwrite without syncing again
+		glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+		void *dst = glMapBufferRange(GL_UNIFORM_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (dst)
+		{
+			memcpy(dst, data, bytes);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+		else
+		{
+			glBufferSubData(GL_UNIFORM_BUFFER, offset, bytes, data);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, this->buffer, offset, bytes);
+		RenderStats::Instance().uniformBlockWrites++;
+	}
+};